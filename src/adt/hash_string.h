@@ -5,6 +5,10 @@
 #ifndef _FIRM_HASH_STRING_H_
 #define _FIRM_HASH_STRING_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 #define _FIRM_FNV_OFFSET_BASIS 2166136261U
 #define _FIRM_FNV_FNV_PRIME 16777619U
 
@@ -36,4 +40,55 @@ unsigned hash_string_size(const char* str, size_t size)
 	return hash;
 }
 
+#define _FIRM_HASH64_MULTIPLIER 0x9E3779B97F4A7C15ULL
+#define _FIRM_HASH64_FINISH     0xFF51AFD7ED558CCDULL
+
+/**
+ * Starts a 64-bit hash of @p size bytes. The bytes are added to the hash in
+ * words of 8 bytes with hash64_add(), a final partial word is zero-padded.
+ */
+static inline uint64_t hash64_begin(size_t size)
+{
+	return size * _FIRM_HASH64_MULTIPLIER;
+}
+
+static inline uint64_t hash64_add(uint64_t hash, uint64_t word)
+{
+	hash  = (hash ^ word) * _FIRM_HASH64_MULTIPLIER;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+static inline uint64_t hash64_finish(uint64_t hash)
+{
+	hash ^= hash >> 32;
+	hash *= _FIRM_HASH64_FINISH;
+	hash ^= hash >> 29;
+	return hash;
+}
+
+/**
+ * Returns a 64-bit hash of the @p size bytes at @p str, computed a word at a
+ * time. Only the low bits are needed for hash tables, all of them depend on
+ * every byte.
+ */
+static inline __attribute__((pure))
+uint64_t hash_string_size64(const char* str, size_t size)
+{
+	uint64_t hash = hash64_begin(size);
+	for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, str, sizeof(word));
+		hash = hash64_add(hash, word);
+		str += sizeof(word);
+	}
+	if (size > 0) {
+		uint64_t word = 0;
+		for (size_t i = 0; i < size; ++i)
+			word |= (uint64_t)(unsigned char)str[i] << (8 * i);
+		hash = hash64_add(hash, word);
+	}
+	return hash64_finish(hash);
+}
+
 #endif
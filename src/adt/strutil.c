@@ -40,3 +40,19 @@ char const *find_extension(char const *path, char const **const name_out)
 		}
 	}
 }
+
+void print_json_string(FILE *const f, const char *const string)
+{
+	fputc('"', f);
+	for (const char *c = string; *c != '\0'; ++c) {
+		unsigned char const uc = (unsigned char)*c;
+		if (uc == '"' || uc == '\\') {
+			fprintf(f, "\\%c", uc);
+		} else if (uc < 0x20) {
+			fprintf(f, "\\u%04x", uc);
+		} else {
+			fputc(uc, f);
+		}
+	}
+	fputc('"', f);
+}
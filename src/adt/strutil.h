@@ -6,6 +6,7 @@
 #define STRUTIL_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 static inline bool streq(char const* a, char const* b)
@@ -32,4 +33,7 @@ bool streq_underscore(const char *s1, const char *s2);
  */
 char const *find_extension(char const *path, char const **name_out);
 
+/** Prints @p string as a JSON string literal, including the quotes. */
+void print_json_string(FILE *f, const char *string);
+
 #endif
@@ -28,6 +28,7 @@
 #include "adt/separator_t.h"
 #include "adt/util.h"
 #include "constfold.h"
+#include "constfoldbits.h"
 #include "dialect.h"
 #include "driver/warning.h"
 #include "printer.h"
@@ -1123,6 +1124,23 @@ static void print_storage_class(storage_class_t storage_class)
 	panic("invalid storage class");
 }
 
+/**
+ * Print the elements of a blob initializer.
+ */
+static void print_blob(const initializer_blob_t *blob)
+{
+	ir_mode             *const mode = get_ir_mode_storage(blob->element_type);
+	size_t               const size = get_mode_size_bytes(mode);
+	unsigned char const *      data = blob->data;
+	for (size_t i = 0; i != blob->len; ++i, data += size) {
+		if (i != 0)
+			print_string(", ");
+		char buf[128];
+		tarval_snprintf(buf, sizeof(buf), new_tarval_from_bytes(data, mode));
+		print_string(buf);
+	}
+}
+
 /**
  * Print an initializer.
  *
@@ -1161,6 +1179,10 @@ void print_initializer(const initializer_t *initializer)
 		print_designator(initializer->designator.designator);
 		print_string(" = ");
 		return;
+
+	case INITIALIZER_BLOB:
+		print_blob(&initializer->blob);
+		return;
 	}
 
 	panic("invalid initializer kind found");
@@ -1419,7 +1441,7 @@ void print_ast(const translation_unit_t *unit)
 			continue;
 
 		/* Skip header expansion */
-		if (entity->base.pos.is_system_header) {
+		if (is_system_header_position(&entity->base.pos)) {
             // Will need to add include line back in :(
 		    continue;
         }
@@ -1435,6 +1457,7 @@ expression_classification_t is_constant_initializer(const initializer_t *initial
 	switch (initializer->kind) {
 	case INITIALIZER_STRING:
 	case INITIALIZER_DESIGNATOR:
+	case INITIALIZER_BLOB:
 		return EXPR_CLASS_CONSTANT;
 
 	case INITIALIZER_VALUE:
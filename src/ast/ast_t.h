@@ -413,7 +413,8 @@ typedef enum initializer_kind_t {
 	INITIALIZER_VALUE,
 	INITIALIZER_LIST,
 	INITIALIZER_STRING,
-	INITIALIZER_DESIGNATOR
+	INITIALIZER_DESIGNATOR,
+	INITIALIZER_BLOB
 } initializer_kind_t;
 
 struct initializer_base_t {
@@ -437,12 +438,26 @@ struct initializer_designator_t {
 	designator_t       *designator;
 };
 
+/**
+ * Consecutive constant elements of an array with real element type. The
+ * values are stored converted to the storage mode of the element type, each
+ * one as written by tarval_to_bytes(). The data follows the initializer or,
+ * for byte elements, is the resource of an #embed directive.
+ */
+struct initializer_blob_t {
+	initializer_base_t   base;
+	type_t              *element_type;
+	size_t               len;          /**< number of elements */
+	const unsigned char *data;
+};
+
 union initializer_t {
 	initializer_kind_t       kind;
 	initializer_base_t       base;
 	initializer_value_t      value;
 	initializer_list_t       list;
 	initializer_designator_t designator;
+	initializer_blob_t       blob;
 };
 
 static inline string_literal_expression_t const *get_init_string(initializer_t const *const init)
@@ -527,6 +542,10 @@ struct switch_statement_t {
 	case_label_statement_t *first_case;
 	case_label_statement_t *last_case;
 	case_label_statement_t *default_label; /**< Default label if existent. */
+	/** The case labels with a value, i.e. not default labels and empty
+	 * ranges, sorted by their first value. */
+	case_label_statement_t **sorted_cases;
+	size_t                   n_sorted_cases;
 };
 
 struct goto_statement_t {
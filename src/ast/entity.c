@@ -5,6 +5,7 @@
 #include "entity_t.h"
 
 #include <assert.h>
+#include <stdint.h>
 
 #include "adt/panic.h"
 #include "adt/strutil.h"
@@ -12,6 +13,86 @@
 #include "ast_t.h"
 #include "type_t.h"
 
+/** Scopes with more entities than this are searched through a hash index. */
+#define ENTITY_INDEX_THRESHOLD 16
+
+typedef struct entity_index_entry_t {
+	symbol_t          *symbol;
+	entity_namespace_t namespc;
+	entity_t          *entity;
+} entity_index_entry_t;
+
+typedef struct entity_index_set_t entity_index_set_t;
+#define HashSet         entity_index_set_t
+#define ValueType       entity_index_entry_t*
+#include "adt/hashset.h"
+#undef ValueType
+#undef HashSet
+
+struct entity_index_t {
+	entity_index_set_t set;
+	entity_t          *last; /**< the last entity of the scope in the index */
+};
+
+#define HashSet                    entity_index_set_t
+#define ValueType                  entity_index_entry_t*
+#define NullValue                  NULL
+#define DeletedValue               ((entity_index_entry_t*)-1)
+#define Hash(this, key)            ((unsigned)((uintptr_t)(key)->symbol >> 3) ^ (key)->namespc)
+#define KeysEqual(this,key1,key2)  ((key1)->symbol == (key2)->symbol && (key1)->namespc == (key2)->namespc)
+#define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(*(ptr)))
+/* the index lives as long as the AST */
+#define Alloc(size)                ((HashSetEntry*)obstack_alloc(&ast_obstack, (size) * sizeof(HashSetEntry)))
+#define Free(ptr)                  ((void)(ptr))
+
+void entity_index_set_init_(entity_index_set_t *set);
+#define hashset_init             entity_index_set_init_
+entity_index_entry_t *entity_index_set_insert_(entity_index_set_t *set, entity_index_entry_t *entry);
+#define hashset_insert           entity_index_set_insert_
+entity_index_entry_t *entity_index_set_find_(const entity_index_set_t *set, const entity_index_entry_t *entry);
+#define hashset_find             entity_index_set_find_
+#define SCALAR_RETURN
+
+#include "adt/hashset.c.h"
+
+static entity_index_t *new_entity_index(void)
+{
+	entity_index_t *const index = OALLOCZ(&ast_obstack, entity_index_t);
+	entity_index_set_init_(&index->set);
+	return index;
+}
+
+/** Adds @p entity as @p symbol unless an earlier entity has this name. */
+static void index_entity(entity_index_t *const index, symbol_t *const symbol,
+                         entity_namespace_t const namespc,
+                         entity_t *const entity)
+{
+	entity_index_entry_t const key = { .symbol = symbol, .namespc = namespc };
+	if (entity_index_set_find_(&index->set, &key) != NULL)
+		return;
+	entity_index_entry_t *const entry = OALLOC(&ast_obstack, entity_index_entry_t);
+	*entry = key;
+	entry->entity = entity;
+	entity_index_set_insert_(&index->set, entry);
+}
+
+static entity_t *find_indexed(entity_index_t const *const index,
+                              symbol_t *const symbol,
+                              entity_namespace_t const namespc)
+{
+	entity_index_entry_t const key   = { .symbol = symbol, .namespc = namespc };
+	entity_index_entry_t const *const entry
+		= entity_index_set_find_(&index->set, &key);
+	return entry != NULL ? entry->entity : NULL;
+}
+
+/** Returns the first entity of @p scope not in @p index yet. */
+static entity_t *first_unindexed(scope_t const *const scope,
+                                 entity_index_t const *const index)
+{
+	return index->last != NULL ? index->last->base.next : scope->first_entity;
+}
+
 const char *get_entity_kind_name(entity_kind_t kind)
 {
 	switch (kind) {
@@ -118,10 +199,66 @@ unsigned get_declaration_alignment(const declaration_t *declaration)
 	return get_ctype_alignment(type);
 }
 
+/**
+ * Adds the members of the anonymous struct or union @p compound as members of
+ * @p member, which is the anonymous member of the indexed compound.
+ */
+static void index_anonymous_members(entity_index_t *const index,
+                                    compound_t const *const compound,
+                                    entity_t *const member)
+{
+	for (entity_t *iter = compound->members.first_entity; iter != NULL;
+	     iter = iter->base.next) {
+		if (iter->kind != ENTITY_COMPOUND_MEMBER)
+			continue;
+
+		if (iter->base.symbol != NULL) {
+			index_entity(index, iter->base.symbol, NAMESPACE_NORMAL, member);
+		} else {
+			type_t *type = skip_typeref(iter->declaration.type);
+			if (is_type_compound(type))
+				index_anonymous_members(index, type->compound.compound, member);
+		}
+	}
+}
+
+static entity_t *find_indexed_compound_entry(compound_t *const compound,
+                                             symbol_t *const symbol)
+{
+	entity_index_t *index = compound->member_index;
+	if (index == NULL) {
+		index = new_entity_index();
+		compound->member_index = index;
+	}
+
+	/* add the members appended since the last lookup */
+	for (entity_t *iter = first_unindexed(&compound->members, index);
+	     iter != NULL; iter = iter->base.next) {
+		index->last = iter;
+		if (iter->kind != ENTITY_COMPOUND_MEMBER)
+			continue;
+
+		if (iter->base.symbol != NULL) {
+			index_entity(index, iter->base.symbol, NAMESPACE_NORMAL, iter);
+		} else {
+			type_t *type = skip_typeref(iter->declaration.type);
+			if (is_type_compound(type))
+				index_anonymous_members(index, type->compound.compound, iter);
+		}
+	}
+	return find_indexed(index, symbol, NAMESPACE_NORMAL);
+}
+
 entity_t *find_compound_entry(compound_t *compound, symbol_t *symbol)
 {
+	if (compound->member_index != NULL)
+		return find_indexed_compound_entry(compound, symbol);
+
+	unsigned n_members = 0;
 	for (entity_t *iter = compound->members.first_entity; iter != NULL;
 	     iter = iter->base.next) {
+		if (++n_members > ENTITY_INDEX_THRESHOLD)
+			return find_indexed_compound_entry(compound, symbol);
 		if (iter->kind != ENTITY_COMPOUND_MEMBER)
 			continue;
 
@@ -140,3 +277,33 @@ entity_t *find_compound_entry(compound_t *compound, symbol_t *symbol)
 
 	return NULL;
 }
+
+entity_t *find_scope_entity(scope_t *const scope, symbol_t *const symbol,
+                            entity_namespace_t const namespc)
+{
+	entity_index_t *index = scope->index;
+	if (index == NULL) {
+		unsigned n_entities = 0;
+		for (entity_t *entity = scope->first_entity; entity != NULL;
+		     entity = entity->base.next) {
+			if (++n_entities > ENTITY_INDEX_THRESHOLD)
+				break;
+			if (entity->base.symbol == symbol && entity->base.namespc == namespc)
+				return entity;
+		}
+		if (n_entities <= ENTITY_INDEX_THRESHOLD)
+			return NULL;
+
+		index = new_entity_index();
+		scope->index = index;
+	}
+
+	/* add the entities appended since the last lookup */
+	for (entity_t *entity = first_unindexed(scope, index); entity != NULL;
+	     entity = entity->base.next) {
+		index->last = entity;
+		if (entity->base.symbol != NULL)
+			index_entity(index, entity->base.symbol, entity->base.namespc, entity);
+	}
+	return find_indexed(index, symbol, namespc);
+}
@@ -76,14 +76,18 @@ typedef enum {
 	BUILTIN_VA_END,
 } builtin_kind_t;
 
+typedef struct entity_index_t entity_index_t;
+
 /**
  * A scope containing entities.
  */
 struct scope_t {
-	entity_t *first_entity;
-	entity_t *last_entity; /**< pointer to last entity (so appending is fast) */
-	unsigned  depth;       /**< while parsing, the depth of this scope in the
-	                            scope stack. */
+	entity_t       *first_entity;
+	entity_t       *last_entity; /**< pointer to last entity (so appending is fast) */
+	/** hash index for find_scope_entity(), built once the scope is large */
+	entity_index_t *index;
+	unsigned        depth;       /**< while parsing, the depth of this scope in the
+	                                  scope stack. */
 };
 
 /**
@@ -108,6 +112,8 @@ struct compound_t {
 	entity_base_t     base;
 	entity_t         *alias; /* used for name mangling of anonymous types */
 	scope_t           members;
+	/** hash index for find_compound_entry(), built once there are many members */
+	entity_index_t   *member_index;
 	decl_modifiers_t  modifiers;
 	attribute_t      *attributes;
 	bool              complete          : 1;
@@ -298,6 +304,17 @@ elf_visibility_t get_elf_visibility_from_string(const char *string);
 
 entity_t *skip_unnamed_bitfields(entity_t*);
 
+/**
+ * Returns the member @p symbol of @p compound, or the anonymous struct or union
+ * member containing it, NULL if there is none.
+ */
 entity_t *find_compound_entry(compound_t *compound, symbol_t *symbol);
 
+/**
+ * Returns the first entity of @p scope named @p symbol in namespace
+ * @p namespc, NULL if there is none.
+ */
+entity_t *find_scope_entity(scope_t *scope, symbol_t *symbol,
+                            entity_namespace_t namespc);
+
 #endif
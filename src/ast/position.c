@@ -0,0 +1,286 @@
+/*
+ * This file is part of cparser.
+ * Copyright (C) 2012 Matthias Braun <matze@braunis.de>
+ */
+#include "position.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "adt/array.h"
+#include "adt/panic.h"
+
+typedef struct line_directive_t {
+	uint32_t    offset;
+	uint32_t    line;   /**< index of the line containing offset */
+	unsigned    lineno;
+	const char *input_name;
+	bool        is_system_header;
+} line_directive_t;
+
+typedef struct input_range_t {
+	/** the position referring to the input as a whole, the text follows */
+	uint32_t          begin;
+	uint32_t          size;
+	const char       *input_name;
+	/** the text of the input, NULL once it must not be accessed anymore */
+	const char       *text;
+	/** frees the text of a closed input once its line table is built */
+	void            (*free_text)(void *data);
+	void             *free_data;
+	/** offsets of the line beginnings in the text, NULL until needed */
+	uint32_t         *line_starts;
+	/** #line directives in the input, NULL if there are none */
+	line_directive_t *directives;
+	bool              is_system_header;
+} input_range_t;
+
+const char       builtin_input_name[] = "<built-in>";
+/* offset 0 is left unused, so zero initialized positions stand out */
+const position_t builtin_position     = { 1 };
+
+/** The maximum number of closed inputs whose text is kept until a position in
+ * them is looked up. Beyond it line tables are built when inputs are closed,
+ * so the memory (and number of file mappings) kept stays bounded. */
+#define MAX_RETAINED_INPUTS 1024
+
+static input_range_t *ranges;
+static uint32_t       next_offset;
+static size_t         n_retained;
+/* most lookups are close to the previous one */
+static size_t         last_range;
+static size_t         last_line;
+
+static position_t add_range(const char *const input_name,
+                            const char *const text, size_t const size,
+                            bool const is_system_header)
+{
+	uint32_t const begin = next_offset;
+	/* the position of the input, its text and the end of the input */
+	size_t const n_offsets = text != NULL ? size + 2 : 1;
+	if (n_offsets > UINT32_MAX - begin)
+		panic("too much input for 32-bit source positions");
+	next_offset = begin + (uint32_t)n_offsets;
+
+	input_range_t const range = {
+		.begin            = begin,
+		.size             = (uint32_t)size,
+		.input_name       = input_name,
+		.text             = text,
+		.is_system_header = is_system_header,
+	};
+	ARR_APP1(input_range_t, ranges, range);
+	return (position_t){ begin };
+}
+
+void init_positions(void)
+{
+	ranges      = NEW_ARR_F(input_range_t, 0);
+	next_offset = 0;
+	n_retained  = 0;
+	last_range  = 0;
+	last_line   = 0;
+	add_range(NULL, NULL, 0, false);
+	position_t const builtin = add_range(builtin_input_name, NULL, 0, true);
+	assert(builtin.offset == builtin_position.offset);
+	(void)builtin;
+}
+
+void exit_positions(void)
+{
+	for (size_t i = 0, n = ARR_LEN(ranges); i != n; ++i) {
+		input_range_t *const range = &ranges[i];
+		if (range->free_text != NULL)
+			range->free_text(range->free_data);
+		if (range->line_starts != NULL)
+			DEL_ARR_F(range->line_starts);
+		if (range->directives != NULL)
+			DEL_ARR_F(range->directives);
+	}
+	DEL_ARR_F(ranges);
+}
+
+position_t add_input_text(const char *const input_name, const char *const text,
+                          size_t const size, bool const is_system_header)
+{
+	assert(text != NULL);
+	position_t const pos = add_range(input_name, text, size, is_system_header);
+	return (position_t){ pos.offset + 1 };
+}
+
+position_t file_position(const char *const input_name)
+{
+	return add_range(input_name, NULL, 0, false);
+}
+
+static input_range_t *find_range(uint32_t const offset)
+{
+	size_t const n_ranges = ARR_LEN(ranges);
+	size_t       lo       = last_range;
+	if (ranges[lo].begin <= offset
+	 && (lo + 1 == n_ranges || offset < ranges[lo + 1].begin))
+		return &ranges[lo];
+
+	/* find the last range beginning at or before offset */
+	lo = 0;
+	size_t hi = n_ranges;
+	while (hi - lo > 1) {
+		size_t const mid = lo + (hi - lo) / 2;
+		if (ranges[mid].begin <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	last_range = lo;
+	last_line  = 0;
+	return &ranges[lo];
+}
+
+static uint32_t *get_line_starts(input_range_t *const range)
+{
+	if (range->line_starts != NULL)
+		return range->line_starts;
+
+	/* "\n", "\r\n" and a lone "\r" end a line */
+	uint32_t         *lines = NEW_ARR_F(uint32_t, 1);
+	const char *const text  = range->text;
+	const char *const end   = text + range->size;
+	lines[0] = 0;
+	/* the next '\n', so the '\r's are only searched for up to it */
+	const char *lf = memchr(text, '\n', range->size);
+	for (const char *p = text;;) {
+		if (lf != NULL && lf < p)
+			lf = memchr(p, '\n', end - p);
+		const char *const line_end = lf != NULL ? lf : end;
+		const char *const cr       = memchr(p, '\r', line_end - p);
+		p = cr != NULL ? cr : line_end;
+		if (p == end)
+			break;
+		if (*p++ == '\r' && p != end && *p == '\n')
+			++p;
+		ARR_APP1(uint32_t, lines, (uint32_t)(p - text));
+	}
+	range->line_starts = lines;
+
+	if (range->free_text != NULL) {
+		range->free_text(range->free_data);
+		range->free_text = NULL;
+		range->text      = NULL;
+		--n_retained;
+	}
+	return lines;
+}
+
+void release_input_text(position_t const start,
+                        void (*const free_text)(void *data), void *const data)
+{
+	input_range_t *const range = find_range(start.offset);
+	assert(range->begin + 1 == start.offset);
+	if (free_text == NULL || range->line_starts != NULL
+	 || n_retained == MAX_RETAINED_INPUTS) {
+		get_line_starts(range);
+		range->text = NULL;
+		if (free_text != NULL)
+			free_text(data);
+		return;
+	}
+	/* the line table is built on the first lookup */
+	range->free_text = free_text;
+	range->free_data = data;
+	++n_retained;
+}
+
+/** Returns the index of the line containing @p text_offset. */
+static size_t find_line(input_range_t *const range, uint32_t const text_offset)
+{
+	uint32_t const *const lines   = get_line_starts(range);
+	size_t          const n_lines = ARR_LEN(lines);
+	size_t                lo      = last_line;
+	if (lo < n_lines && lines[lo] <= text_offset
+	 && (lo + 1 == n_lines || text_offset < lines[lo + 1]))
+		return lo;
+
+	lo = 0;
+	size_t hi = n_lines;
+	while (hi - lo > 1) {
+		size_t const mid = lo + (hi - lo) / 2;
+		if (lines[mid] <= text_offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	last_line = lo;
+	return lo;
+}
+
+static line_directive_t const *find_directive(input_range_t const *const range,
+                                              uint32_t const offset)
+{
+	line_directive_t const *const directives = range->directives;
+	if (directives == NULL || offset < directives[0].offset)
+		return NULL;
+
+	size_t lo = 0;
+	size_t hi = ARR_LEN(directives);
+	while (hi - lo > 1) {
+		size_t const mid = lo + (hi - lo) / 2;
+		if (directives[mid].offset <= offset) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return &directives[lo];
+}
+
+void add_line_directive(position_t const pos, const char *const input_name,
+                        unsigned const lineno, bool const is_system_header)
+{
+	input_range_t *const range = find_range(pos.offset);
+	assert(pos.offset > range->begin && range->text != NULL);
+	line_directive_t const directive = {
+		.offset           = pos.offset,
+		.line             = find_line(range, pos.offset - range->begin - 1),
+		.lineno           = lineno,
+		.input_name       = input_name,
+		.is_system_header = is_system_header,
+	};
+	if (range->directives == NULL)
+		range->directives = NEW_ARR_F(line_directive_t, 0);
+	ARR_APP1(line_directive_t, range->directives, directive);
+}
+
+position_info_t get_position_info(const position_t *const pos)
+{
+	uint32_t       const offset = pos->offset;
+	input_range_t *const range  = find_range(offset);
+	position_info_t info = {
+		.input_name       = range->input_name,
+		.is_system_header = range->is_system_header,
+	};
+	if (offset == range->begin)
+		return info;
+
+	uint32_t const text_offset = offset - range->begin - 1;
+	size_t   const line        = find_line(range, text_offset);
+	info.lineno = line + 1;
+	info.colno  = text_offset - range->line_starts[line] + 1;
+
+	line_directive_t const *const directive = find_directive(range, offset);
+	if (directive != NULL) {
+		info.input_name       = directive->input_name;
+		info.lineno           = directive->lineno + (line - directive->line);
+		info.is_system_header = directive->is_system_header;
+	}
+	return info;
+}
+
+bool is_system_header_position(const position_t *const pos)
+{
+	input_range_t const *const range = find_range(pos->offset);
+	if (range->directives == NULL)
+		return range->is_system_header;
+	return get_position_info(pos).is_system_header;
+}
@@ -6,16 +6,68 @@
 #define POSITION_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+/**
+ * A position in the source code. All inputs are laid out one after another in
+ * a single offset space, file name, line and column of a position are only
+ * computed when needed by get_position_info().
+ */
 typedef struct position_t position_t;
 struct position_t {
+	uint32_t offset;
+};
+
+typedef struct position_info_t position_info_t;
+struct position_info_t {
 	const char *input_name;
-	unsigned    lineno;
-	unsigned    colno            : 31;
-	bool        is_system_header : 1;
+	unsigned    lineno; /**< 0 if the position refers to a whole file */
+	unsigned    colno;  /**< 0 if the position refers to a whole line */
+	bool        is_system_header;
 };
 
 /* position used for "builtin" declarations/types */
 extern const position_t builtin_position;
+/* name of the input containing builtin_position */
+extern const char builtin_input_name[];
+
+/**
+ * Sets up an empty offset space. Each compilation unit starts with its own
+ * one, positions of the previous unit become invalid.
+ */
+void init_positions(void);
+void exit_positions(void);
+
+/**
+ * Adds an input of @p size bytes at @p text to the offset space and returns
+ * the position of its first byte. The position directly before it refers to
+ * the input as a whole. @p text must stay valid until release_input_text().
+ */
+position_t add_input_text(const char *input_name, const char *text,
+                          size_t size, bool is_system_header);
+
+/**
+ * Marks the input starting at @p start as closed. If @p free_text is NULL, the
+ * line table is computed right away, as the text becomes invalid. Otherwise
+ * the text may be kept until the line table is needed, free_text(data) is
+ * called when it is not accessed anymore.
+ */
+void release_input_text(position_t start, void (*free_text)(void *data),
+                        void *data);
+
+/** Returns a position referring to the file @p input_name as a whole. */
+position_t file_position(const char *input_name);
+
+/**
+ * Makes the line containing @p pos and the following lines of its input
+ * numbered from @p lineno in the file @p input_name (#line directive).
+ */
+void add_line_directive(position_t pos, const char *input_name,
+                        unsigned lineno, bool is_system_header);
+
+position_info_t get_position_info(const position_t *pos);
+
+bool is_system_header_position(const position_t *pos);
 
 #endif
@@ -30,7 +30,7 @@ static inline bool strings_equal(const string_t *str1, const string_t *str2)
 #define ConstKeyType              const string_t*
 //#define GetKey(value)             (value)
 //#define InitData(this,value,key)  (value) = (key)
-#define Hash(this,key)            hash_string_size(key->begin, key->size)
+#define Hash(this,key)            ((unsigned)hash_string_size64(key->begin, key->size))
 #define KeysEqual(this,key1,key2) strings_equal(key1, key2)
 #define SetRangeEmpty(ptr,size)   memset(ptr, 0, (size) * sizeof(HashSetEntry))
 #define SCALAR_RETURN
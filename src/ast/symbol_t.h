@@ -12,6 +12,7 @@
 
 struct symbol_t {
 	char const      *string;
+	size_t           size;
 	token_kind_t     ID;
 	pp_token_kind_t  pp_ID;
 	entity_t        *entity;
@@ -4,6 +4,10 @@
  */
 #include "symbol_table_t.h"
 
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
 #include "adt/hash_string.h"
 #include "adt/obst.h"
 #include "adt/strutil.h"
@@ -12,27 +16,50 @@
 
 struct obstack symbol_obstack;
 
+/**
+ * Key used for symbol table lookups, the string does not need to be '\0'
+ * terminated.
+ */
+typedef struct symbol_key_t {
+	const char *string;
+	size_t      size;
+	/** hash_string_size64() of the string */
+	uint64_t    hash;
+	/** copy the string to symbol_obstack when a new symbol is created */
+	bool        copy;
+} symbol_key_t;
+
 static inline
-void init_symbol_table_entry(symbol_t *entry, const char *string)
+void init_symbol_table_entry(symbol_t *entry, symbol_key_t const key)
 {
-	entry->string        = string;
+	entry->string        = key.copy
+	                     ? obstack_copy0(&symbol_obstack, key.string, key.size)
+	                     : key.string;
+	entry->size          = key.size;
 	entry->ID            = T_IDENTIFIER;
 	entry->pp_ID         = TP_NULL;
 	entry->entity        = NULL;
 	entry->pp_definition = NULL;
 }
 
+static inline bool key_equal(symbol_t const *const symbol,
+                             symbol_key_t const key)
+{
+	return symbol->size == key.size
+	    && memcmp(symbol->string, key.string, key.size) == 0;
+}
+
 #define HashSet                    symbol_table_t
 #define HashSetEntry               symbol_table_hash_entry_t
 #define ValueType                  symbol_t*
 #define NullValue                  NULL
 #define DeletedValue               ((symbol_t*)-1)
-#define KeyType                    const char *
-#define ConstKeyType               const char *
-#define GetKey(value)              (value)->string
+#define KeyType                    symbol_key_t
+#define ConstKeyType               symbol_key_t
+#define GetKey(value)              (value)
 #define InitData(this,value,key)   ((void)((value) = (ValueType)obstack_alloc(&symbol_obstack, sizeof(symbol_t)), init_symbol_table_entry((value), key)))
-#define Hash(this, key)            hash_string(key)
-#define KeysEqual(this,key1,key2)  (streq(key1, key2))
+#define Hash(this, key)            ((unsigned)(key).hash)
+#define KeysEqual(this,key1,key2)  key_equal(key1, key2)
 #define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(symbol_table_hash_entry_t))
 #define SCALAR_RETURN
 
@@ -40,7 +67,7 @@ void symbol_table_init_(symbol_table_t *symbol_table);
 #define hashset_init            symbol_table_init_
 void symbol_table_destroy_(symbol_table_t *symbol_table);
 #define hashset_destroy         symbol_table_destroy_
-symbol_t *symbol_table_insert_(symbol_table_t *symbol_table, const char *key);
+symbol_t *symbol_table_insert_(symbol_table_t *symbol_table, symbol_key_t key);
 #define hashset_insert          symbol_table_insert_
 void symbol_table_iterator_init_(symbol_table_iterator_t *iterator, const symbol_table_t *table);
 #define hashset_iterator_init   symbol_table_iterator_init_
@@ -54,7 +81,19 @@ symbol_t *sym_anonymous;
 
 symbol_t *symbol_table_insert(const char *string)
 {
-	return symbol_table_insert_(&symbol_table, string);
+	size_t       const size = strlen(string);
+	symbol_key_t const key  = {
+		string, size, hash_string_size64(string, size), false
+	};
+	return symbol_table_insert_(&symbol_table, key);
+}
+
+symbol_t *symbol_table_insert_hashed(const char *string, size_t size,
+                                     uint64_t hash)
+{
+	assert(hash == hash_string_size64(string, size));
+	symbol_key_t const key = { string, size, hash, true };
+	return symbol_table_insert_(&symbol_table, key);
 }
 
 void init_symbol_table(void)
@@ -5,11 +5,23 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "adt/obst.h"
 #include "symbol.h"
 
 symbol_t *symbol_table_insert(const char *string);
 
+/**
+ * Returns the symbol for the first @p size characters of @p string, which
+ * need not be '\0' terminated. @p hash must be hash_string_size64() of these
+ * characters, so callers can compute it while scanning them. The characters
+ * are copied to symbol_obstack when a new symbol is created.
+ */
+symbol_t *symbol_table_insert_hashed(const char *string, size_t size,
+                                     uint64_t hash);
+
 void init_symbol_table(void);
 void exit_symbol_table(void);
 
@@ -207,6 +207,7 @@ static void walk_initializer(const initializer_t  *initializer,
 		return;
 
 	case INITIALIZER_STRING:
+	case INITIALIZER_BLOB:
 		return;
 	}
 }
@@ -79,6 +79,7 @@ bool            include_system_headers_in_dependencies;
 bool            print_phony_targets;
 const char     *dependency_file;
 const char     *dependency_target;
+const char     *pp_profile_file;
 bool            dont_escape_target;
 lang_features_t features_on;
 lang_features_t features_off;
@@ -249,7 +250,7 @@ static void init_c_dialect(bool const is_cpp, compilation_unit_t const *const un
 		case STANDARD_CXX98:
 		case STANDARD_GNUXX98:
 		case STANDARD_DEFAULT: {
-			position_t const pos = { unit->name, 0, 0, 0 };
+			position_t const pos = file_position(unit->name);
 			warningf(WARN_OTHER, &pos, "command line option '%hs%hs' is not valid for C", "-std=", str_lang_standard(standard));
 		} /* FALLTHROUGH */
 		case STANDARD_GNU99:   features = _C89 | _C99 | _GNUC; break;
@@ -269,7 +270,7 @@ static void init_c_dialect(bool const is_cpp, compilation_unit_t const *const un
 		case STANDARD_GNU99:
 		case STANDARD_GNU11:
 		case STANDARD_DEFAULT: {
-			position_t const pos = { unit->name, 0, 0, 0 };
+			position_t const pos = file_position(unit->name);
 			warningf(WARN_OTHER, &pos, "command line option '%hs%hs' is not valid for C++", "-std=", str_lang_standard(standard));
 		} /* FALLTHROUGH */
 		case STANDARD_GNUXX98: features = _CXX | _GNUC; break;
@@ -408,7 +409,7 @@ static bool run_external_preprocessor(compilation_env_t *env,
 	}
 	FILE *f = popen(commandline, "r");
 	if (f == NULL) {
-		position_t const pos = { unit->name, 0, 0, 0 };
+		position_t const pos = file_position(unit->name);
 		errorf(&pos, "invoking preprocessor failed");
 		return false;
 	}
@@ -471,7 +472,7 @@ static bool assemble(compilation_unit_t *unit, const char *o_name)
 	}
 	int err = system(commandline);
 	if (err != EXIT_SUCCESS) {
-		position_t const pos = { unit->name, 0, 0, 0 };
+		position_t const pos = file_position(unit->name);
 		errorf(&pos, "assembler reported an error");
 		unlink(o_name);
 		return false;
@@ -559,6 +560,8 @@ static bool start_preprocessing(compilation_env_t *env,
 		print_include_paths();
 
 	add_predefined_macros();
+	if (pp_profile_file != NULL)
+		start_pp_profile();
 	switch_pp_input(unit->input, unit->name, NULL, false);
 
 	switch (unit->type) {
@@ -609,6 +612,21 @@ static void write_preproc_dependencies(FILE *out, compilation_env_t *env,
 	                                print_phony_targets);
 }
 
+static void write_pp_profile(void)
+{
+	/* the profiles of all compilation units go into the same file */
+	static bool appending = false;
+	FILE *const out = fopen(pp_profile_file, appending ? "a" : "w");
+	if (out == NULL) {
+		errorf(NULL, "Opening profile file '%s' failed: %s", pp_profile_file,
+		       strerror(errno));
+		return;
+	}
+	appending = true;
+	print_pp_profile(out);
+	fclose(out);
+}
+
 static bool finish_preprocessing(compilation_env_t *env,
                                  compilation_unit_t *unit)
 {
@@ -619,6 +637,8 @@ static bool finish_preprocessing(compilation_env_t *env,
 
 	close_pp_input();
 	set_preprocessor_output(NULL);
+	if (pp_profile_file != NULL)
+		write_pp_profile();
 	bool res = close_input(unit);
 	if (!res || error_count > 0)
 		return false;
@@ -640,6 +660,7 @@ static bool finish_preprocessing(compilation_env_t *env,
 static bool do_print_preprocessing_tokens(FILE *out, compilation_env_t *env,
                                           compilation_unit_t *unit)
 {
+	trace_begin("Preprocess", NULL);
 	set_preprocessor_output(out);
 	print_pp_header();
 
@@ -650,9 +671,11 @@ static bool do_print_preprocessing_tokens(FILE *out, compilation_env_t *env,
 		emit_pp_token();
 	}
 
-	fputc('\n', out);
+	finish_pp_output();
 	check_unclosed_conditionals();
-	return finish_preprocessing(env, unit);
+	bool res = finish_preprocessing(env, unit);
+	trace_end();
+	return res;
 }
 
 bool print_preprocessing_tokens(compilation_env_t *env,
@@ -683,15 +706,14 @@ static bool print_preprocessed_intermediate(compilation_env_t *env,
 static bool do_print_dependencies(compilation_env_t *env,
                                   compilation_unit_t *unit)
 {
+	trace_begin("Scan dependencies", NULL);
 	set_preprocessor_output(NULL);
-	do {
-		next_preprocessing_token();
-	} while(pp_token.kind != T_EOF);
-	/* set to false, because finish_preprocessing should not print the deps,
-	 * we will do that ourself here */
-	construct_dep_target = false;
+	scan_preprocessing_directives();
+	/* with -MD/-MMD finish_preprocessing writes a dependency file for each
+	 * input, otherwise we print the dependencies ourself */
 	bool res = finish_preprocessing(env, unit);
-	if (res) {
+	trace_end();
+	if (res && !construct_dep_target) {
 		write_preproc_dependencies(env->out, env, unit);
 	}
 	return res;
@@ -712,6 +734,7 @@ bool do_parsing(compilation_env_t *env, compilation_unit_t *unit)
 	ir_timer_t *t_parsing = ir_timer_new();
 	timer_register(t_parsing, "Frontend: Parsing");
 	timer_start(t_parsing);
+	trace_begin("Parse", NULL);
 
 	init_parser_and_ast(unit);
 
@@ -721,6 +744,7 @@ bool do_parsing(compilation_env_t *env, compilation_unit_t *unit)
 	unit->ast = finish_parsing();
 	check_unclosed_conditionals();
 	bool res = finish_preprocessing(env, unit);
+	trace_end();
 
 	unit->type = COMPILATION_UNIT_AST;
 	timer_stop(t_parsing);
@@ -731,25 +755,6 @@ bool do_parsing(compilation_env_t *env, compilation_unit_t *unit)
 	return res && error_count == 0;
 }
 
-static void node_counter(ir_node *node, void *env)
-{
-	(void)node;
-	unsigned long long *count = (unsigned long long*)env;
-	++(*count);
-}
-
-static unsigned long long count_firm_nodes(void)
-{
-	unsigned long long count = 0;
-
-	int n_irgs = get_irp_n_irgs();
-	for (int i = 0; i < n_irgs; ++i) {
-		ir_graph *irg = get_irp_irg(i);
-		irg_walk_graph(irg, node_counter, NULL, &count);
-	}
-	return count;
-}
-
 static bool already_constructed_firm = false;
 
 bool build_firm_ir(compilation_env_t *env, compilation_unit_t *unit)
@@ -762,7 +767,9 @@ bool build_firm_ir(compilation_env_t *env, compilation_unit_t *unit)
 		panic("compiling multiple files/translation units not yet supported");
 	already_constructed_firm = true;
 	init_implicit_optimizations();
+	trace_begin("Construct IR", NULL);
 	translation_unit_to_firm(unit->ast);
+	trace_end();
 	timer_stop(t_construct);
 	if (stat_ev_enabled) {
 		stat_ev_dbl("time_graph_construction",
@@ -782,7 +789,7 @@ static bool read_ir_file(compilation_env_t *env, compilation_unit_t *unit)
 	if (!open_input(unit))
 		return false;
 	if (ir_import_file(unit->input, unit->name)) {
-		position_t const pos = { unit->name, 0, 0, 0 };
+		position_t const pos = file_position(unit->name);
 		errorf(&pos, "import of firm graph failed");
 		return false;
 	}
@@ -794,6 +801,8 @@ static bool read_ir_file(compilation_env_t *env, compilation_unit_t *unit)
 bool do_print_ast(compilation_env_t *env, compilation_unit_t *unit)
 {
     infer_types(unit->ast, env);
+	/* skipped function bodies are empty */
+	assert(!lazy_function_bodies);
 
 	if (!open_output(env))
 		return false;
@@ -960,7 +969,7 @@ bool link_program(compilation_env_t *env, compilation_unit_t *units)
 				fputs(buf, stderr);
 			}
 			fclose(temp);
-			position_t const pos = {outname, 0, 0, 0};
+			position_t const pos = file_position(outname);
 			errorf(&pos, "linker reported an error");
 			unlink(outname);
 			return false;
@@ -978,7 +987,7 @@ bool write_ir_file(compilation_env_t *env, compilation_unit_t *unit)
 	close_output(env);
 
 	if (errors != 0) {
-		position_t const pos = { env->outname, 0, 0, 0 };
+		position_t const pos = file_position(env->outname);
 		errorf(&pos, "writing to output failed");
 		unlink(env->outname);
 		return false;
@@ -1034,7 +1043,7 @@ int action_print_file_name(const char *argv0)
 	}
 	int err = system(commandline);
 	if (err != EXIT_SUCCESS) {
-		position_t const pos = { print_file_name_file, 0, 0, 0 };
+		position_t const pos = file_position(print_file_name_file);
 		errorf(&pos, "linker reported an error");
 	}
 	obstack_free(&ldflags_obst, commandline);
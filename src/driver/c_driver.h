@@ -37,6 +37,7 @@ extern bool            include_system_headers_in_dependencies;
 extern bool            print_phony_targets;
 extern const char     *dependency_file;
 extern const char     *dependency_target;
+extern const char     *pp_profile_file;
 extern bool            dont_escape_target;
 extern const char     *dumpfunction;
 /** -1: auto (use if not crosscompiling), 0 - no, 1 - yes */
@@ -85,12 +85,13 @@ static void diagnosticvf(position_t const *const pos,
 
 	fputs(colors.highlight, out);
 	if (pos) {
-		if (pos->colno != 0 && show_column) {
-			fprintf(out, "%s:%u:%u: ", pos->input_name, pos->lineno, (unsigned)pos->colno);
-		} else if (pos->lineno != 0) {
-			fprintf(out, "%s:%u: ", pos->input_name, pos->lineno);
+		position_info_t const info = get_position_info(pos);
+		if (info.colno != 0 && show_column) {
+			fprintf(out, "%s:%u:%u: ", info.input_name, info.lineno, info.colno);
+		} else if (info.lineno != 0) {
+			fprintf(out, "%s:%u: ", info.input_name, info.lineno);
 		} else {
-			fprintf(out, "%s: ", pos->input_name);
+			fprintf(out, "%s: ", info.input_name);
 		}
 	}
 
@@ -292,7 +293,8 @@ void notef(position_t const *const pos, char const *const fmt, ...)
 
 bool warningf(warning_t const warn, position_t const* pos, char const *const fmt, ...)
 {
-	if (pos != NULL && pos->is_system_header && !is_warn_on(WARN_SYSTEM_HEADERS))
+	if (pos != NULL && !is_warn_on(WARN_SYSTEM_HEADERS)
+	 && is_system_header_position(pos))
 		return false;
 
 	warning_switch_t const *const s = get_warn_switch(warn);
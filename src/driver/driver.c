@@ -25,6 +25,8 @@ const char         *filtev;
 int                 colorterm;
 bool                do_timing;
 bool                print_timing;
+const char         *time_trace_file;
+unsigned            time_trace_granularity = 500;
 const char         *driver_default_exe_output;
 struct obstack      file_obst;
 compilation_unit_t *units;
@@ -117,7 +119,7 @@ bool open_input(compilation_unit_t *unit)
 	} else {
 		unit->input = fopen(inputname, "r");
 		if (unit->input == NULL) {
-			position_t const pos = { inputname, 0, 0, 0 };
+			position_t const pos = file_position(inputname);
 			errorf(&pos, "could not open: %s", strerror(errno));
 			return false;
 		}
@@ -151,7 +153,7 @@ bool open_output(compilation_env_t *env)
 	} else {
 		out = fopen(outname, "w");
 		if (out == NULL) {
-			position_t const pos = { outname, 0, 0, 0 };
+			position_t const pos = file_position(outname);
 			errorf(&pos, "could not open for writing: %s", strerror(errno));
 			return false;
 		}
@@ -251,7 +253,9 @@ bool process_all_units(compilation_env_t *env)
 		}
 
 		stat_ev_ctx_push_str("compilation_unit", unit->name);
+		trace_begin("Compilation unit", unit->name);
 		bool ok = process_unit(env, unit);
+		trace_end();
 		stat_ev_ctx_pop("compilation_unit");
 		if (!ok) {
 			return false;
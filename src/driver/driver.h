@@ -49,6 +49,8 @@ extern const char         *filtev;
 extern int                 colorterm;
 extern bool                do_timing;
 extern bool                print_timing;
+extern const char         *time_trace_file;
+extern unsigned            time_trace_granularity;
 extern struct obstack      file_obst;
 extern compilation_unit_t *units;
 
@@ -43,4 +43,6 @@
 #define HAVE_FILENO
 #define HAVE_ASCTIME_R
 #define HAVE_FSTAT
+#define HAVE_MMAP
+#define HAVE_OPENDIR
 #endif
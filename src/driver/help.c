@@ -133,6 +133,8 @@ static void print_help_preprocessor(void)
 	help_spaced("-Xpreprocessor", "OPTION", "Pass option directly to preprocessor");
 	help_equals("-finput-charset", "CHARSET", "Select encoding of input files");
 	help_f_yesno("-fdollars-in-identifiers", "Accept dollar symbol in identifiers");
+	help_f_yesno("-fdirectives-only",       "With -E: evaluate directives, keep macros unexpanded");
+	help_equals("-fpp-profile", "FILE",     "Write a JSON profile of included files and macro expansions");
 	/* Undocumented:
 	 * help_simple("-fno-dollars-in-identifiers", "");
 	 */
@@ -280,6 +282,8 @@ static void print_help_debug(void)
 	help_simple("--print-parenthesis",      "");
 	help_simple("--benchmark",              "Preprocess and parse, produces no output");
 	help_simple("--time",                   "Measure time of compiler passes");
+	help_equals("-ftime-trace", "FILE",     "Write a Chrome trace_event timeline of the compiler phases");
+	help_equals("-ftime-trace-granularity", "USEC", "Omit spans shorter than USEC microseconds (default 500)");
 	help_simple("--statev",                 "Produce statev output");
 	help_equals("--filtev", "FILTER",       "Set statev filter regex");
 	help_spaced("--dump-function", "FUNC",  "Preprocess, parse and output vcg graph of func");
@@ -5,7 +5,10 @@
 #include "options.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <libfirm/be.h>
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "actions.h"
@@ -214,6 +217,12 @@ add_arg_opt:
 		no_dollar_in_symbol = false;
 	} else if (simple_arg("fno-dollars-in-identifiers", s)) {
 		no_dollar_in_symbol = true;
+	} else if (simple_arg("fdirectives-only", s)) {
+		directives_only = true;
+	} else if (simple_arg("fno-directives-only", s)) {
+		directives_only = false;
+	} else if ((arg = equals_arg("fpp-profile", s)) != NULL) {
+		pp_profile_file = arg;
 	} else {
 		return false;
 	}
@@ -330,6 +339,20 @@ bool options_parse_driver(options_state_t *s)
 	} else if (simple_arg("-time", s)) {
 		do_timing    = true;
 		print_timing = true;
+	} else if ((arg = equals_arg("ftime-trace", s)) != NULL) {
+		time_trace_file = arg;
+	} else if ((arg = equals_arg("ftime-trace-granularity", s)) != NULL) {
+		/* strtoul() would accept leading blanks and a sign */
+		char *end;
+		errno = 0;
+		unsigned long const value = strtoul(arg, &end, 10);
+		if (arg[0] < '0' || arg[0] > '9' || *end != '\0' || errno != 0
+		 || value > UINT_MAX) {
+			errorf(NULL, "invalid granularity '%s' for '-ftime-trace-granularity'", arg);
+			s->argument_errors = true;
+		} else {
+			time_trace_granularity = (unsigned)value;
+		}
 	} else if (simple_arg("-statev", s)) {
 		do_timing      = true;
 		produce_statev = true;
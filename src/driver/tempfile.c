@@ -79,7 +79,7 @@ static const char *make_tempsubdir(const char *tempdir)
 	char       *const templ = obstack_nul_finish(&file_obst);
 	char const *const dir   = mkdtemp(templ);
 	if (dir == NULL) {
-		position_t const pos = { templ, 0, 0, 0 };
+		position_t const pos = file_position(templ);
 		errorf(&pos, "mkdtemp could not create a directory from template");
 		panic("abort");
 	}
@@ -97,7 +97,7 @@ FILE *make_temp_file(const char *name_orig, const char **name_result)
 	char *const name = obstack_nul_finish(&file_obst);
 	FILE *const out  = fopen(name, "w");
 	if (out == NULL) {
-		position_t const pos = { name, 0, 0, 0 };
+		position_t const pos = file_position(name);
 		errorf(&pos, "could not create temporary file: %s", strerror(errno));
 		panic("abort");
 	}
@@ -9,7 +9,13 @@
  */
 #include "timing.h"
 
+#include <assert.h>
 #include <libfirm/adt/xmalloc.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "adt/array.h"
+#include "adt/strutil.h"
 
 static int timers_inited;
 
@@ -86,3 +92,134 @@ void timer_stop(ir_timer_t *timer)
 	if (timers_inited)
 		ir_timer_stop(timer);
 }
+
+typedef struct trace_span_t {
+	const char   *name;
+	const char   *detail;
+	position_t    pos;      /**< detail if it is NULL, 0 if there is none */
+	unsigned long begin_usec;
+} trace_span_t;
+
+typedef struct trace_event_t {
+	const char   *name;
+	char         *detail;
+	unsigned long begin_usec;
+	unsigned long duration_usec;
+} trace_event_t;
+
+static bool           tracing;
+static unsigned       trace_granularity;
+static ir_timer_t    *trace_timer;
+static trace_span_t  *trace_stack;
+static trace_event_t *trace_events;
+
+static unsigned long trace_now(void)
+{
+	ir_timer_stop(trace_timer);
+	unsigned long const now = ir_timer_elapsed_usec(trace_timer);
+	ir_timer_start(trace_timer);
+	return now;
+}
+
+void trace_init(unsigned const granularity_usec)
+{
+	trace_granularity = granularity_usec;
+	trace_timer       = ir_timer_new();
+	trace_stack       = NEW_ARR_F(trace_span_t, 0);
+	trace_events      = NEW_ARR_F(trace_event_t, 0);
+	ir_timer_reset_and_start(trace_timer);
+	tracing = true;
+}
+
+static void trace_push(const char *const name, const char *const detail,
+                       position_t const pos)
+{
+	trace_span_t const span = {
+		.name       = name,
+		.detail     = detail,
+		.pos        = pos,
+		.begin_usec = trace_now(),
+	};
+	ARR_APP1(trace_span_t, trace_stack, span);
+}
+
+void trace_begin(const char *const name, const char *const detail)
+{
+	if (tracing)
+		trace_push(name, detail, (position_t){ 0 });
+}
+
+void trace_begin_at(const char *const name, const position_t *const pos)
+{
+	if (tracing)
+		trace_push(name, NULL, *pos);
+}
+
+static char *format_position(position_t const pos)
+{
+	position_info_t const info = get_position_info(&pos);
+	if (info.input_name == NULL)
+		return NULL;
+	size_t const size = strlen(info.input_name) + 12;
+	char  *const buf  = XMALLOCN(char, size);
+	snprintf(buf, size, "%s:%u", info.input_name, info.lineno);
+	return buf;
+}
+
+void trace_end(void)
+{
+	if (!tracing)
+		return;
+	size_t const depth = ARR_LEN(trace_stack);
+	assert(depth > 0);
+	trace_span_t const *const span     = &trace_stack[depth - 1];
+	unsigned long       const duration = trace_now() - span->begin_usec;
+	if (duration >= trace_granularity) {
+		trace_event_t const event = {
+			.name          = span->name,
+			.detail        = span->detail != NULL ? xstrdup(span->detail)
+			               : span->pos.offset != 0 ? format_position(span->pos)
+			               : NULL,
+			.begin_usec    = span->begin_usec,
+			.duration_usec = duration,
+		};
+		ARR_APP1(trace_event_t, trace_events, event);
+	}
+	ARR_SHRINKLEN(trace_stack, depth - 1);
+}
+
+void trace_term(FILE *const f)
+{
+	assert(tracing);
+	/* close spans left open by an error exit */
+	while (ARR_LEN(trace_stack) > 0)
+		trace_end();
+	tracing = false;
+
+	if (f != NULL) {
+		fputs("{\"traceEvents\":[\n", f);
+		fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"cparser\"}}", f);
+	}
+	for (size_t i = 0, n = ARR_LEN(trace_events); i != n; ++i) {
+		trace_event_t *const event = &trace_events[i];
+		if (f != NULL) {
+			fputs(",\n{\"name\":", f);
+			print_json_string(f, event->name);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":0,\"ts\":%lu,\"dur\":%lu",
+			        event->begin_usec, event->duration_usec);
+			if (event->detail != NULL) {
+				fputs(",\"args\":{\"detail\":", f);
+				print_json_string(f, event->detail);
+				fputc('}', f);
+			}
+			fputc('}', f);
+		}
+		free(event->detail);
+	}
+	if (f != NULL)
+		fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+
+	DEL_ARR_F(trace_events);
+	DEL_ARR_F(trace_stack);
+	ir_timer_free(trace_timer);
+}
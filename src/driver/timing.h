@@ -13,6 +13,8 @@
 #include <stdio.h>
 #include <libfirm/timing.h>
 
+#include "ast/position.h"
+
 void timer_init(void);
 void timer_register(ir_timer_t *timer, const char *description);
 void timer_term(FILE *f);
@@ -21,4 +23,23 @@ void timer_pop(ir_timer_t *timer);
 void timer_start(ir_timer_t *timer);
 void timer_stop(ir_timer_t *timer);
 
+/**
+ * Start recording a timeline of nested spans, spans shorter than
+ * @p granularity_usec are dropped.
+ */
+void trace_init(unsigned granularity_usec);
+/**
+ * Stop recording and write the spans as Chrome trace_event JSON to @p f
+ * (may be NULL).
+ */
+void trace_term(FILE *f);
+/**
+ * Begin a span, which ends with the next unmatched trace_end().
+ * @p name and @p detail (may be NULL) must stay valid until then.
+ */
+void trace_begin(const char *name, const char *detail);
+/** Begin a span whose detail is the source position @p pos. */
+void trace_begin_at(const char *name, const position_t *pos);
+void trace_end(void);
+
 #endif
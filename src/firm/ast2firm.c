@@ -30,6 +30,7 @@
 #include "ast/type_t.h"
 #include "ast/walk.h"
 #include "driver/diagnostic.h"
+#include "driver/timing.h"
 #include "driver/warning.h"
 #include "firm/firm_opt.h"
 #include "jump_target.h"
@@ -109,7 +110,8 @@ static src_loc_t dbg_retrieve(const dbg_info *dbg)
 {
 	position_t const *const pos = (position_t const*)dbg;
 	if (pos) {
-		return (src_loc_t){ pos->input_name, pos->lineno, pos->colno };
+		position_info_t const info = get_position_info(pos);
+		return (src_loc_t){ info.input_name, info.lineno, info.colno };
 	} else {
 		return (src_loc_t){ NULL, 0, 0 };
 	}
@@ -2039,7 +2041,8 @@ static ir_node *compound_literal_to_firm(
 			return string_to_firm(&expr->base.pos,
 			                      get_init_string(initializer)->value);
 		case INITIALIZER_LIST:
-		case INITIALIZER_DESIGNATOR: {
+		case INITIALIZER_DESIGNATOR:
+		case INITIALIZER_BLOB: {
 			/* shouldn't really happen in valid programs, return 0 for
 			 * invalid ones... */
 			ir_mode *mode = get_ir_mode_arithmetic(type);
@@ -3575,6 +3578,33 @@ static bool is_string_type(type_t *type)
 	return is_type_integer(inner);
 }
 
+/**
+ * Sets the elements packed in a blob initializer, starting at the current
+ * object of @p path.
+ */
+static void set_ir_initializer_blob(type_path_t *const path,
+                                    const initializer_blob_t *const blob)
+{
+	type_t *const element_type = skip_typeref(blob->element_type);
+	/* we might have to descend into types until the types match */
+	while (!types_compatible(skip_typeref(path->top_type), element_type))
+		descend_into_subtype(path, &blob->base.pos);
+
+	ir_mode             *const mode = get_ir_mode_storage(element_type);
+	size_t               const size = get_mode_size_bytes(mode);
+	unsigned char const *      data = blob->data;
+	for (size_t i = 0; i != blob->len; ++i, data += size) {
+		ir_tarval        *const tv     = new_tarval_from_bytes(data, mode);
+		ir_initializer_t *const tvinit = create_initializer_tarval(tv);
+
+		type_path_entry_t *const entry = get_type_path_top(path);
+		set_initializer_compound_value(entry->initializer, entry->index,
+		                               tvinit);
+
+		advance_current_object(path);
+	}
+}
+
 static ir_initializer_t *create_ir_initializer_list(
 		const initializer_list_t *initializer, type_t *type)
 {
@@ -3592,6 +3622,10 @@ static ir_initializer_t *create_ir_initializer_list(
 			walk_designator(&path, sub_initializer->designator.designator);
 			continue;
 		}
+		if (sub_initializer->kind == INITIALIZER_BLOB) {
+			set_ir_initializer_blob(&path, &sub_initializer->blob);
+			continue;
+		}
 
 		if (sub_initializer->kind == INITIALIZER_VALUE) {
 			const expression_t *expr      = sub_initializer->value.value;
@@ -3691,6 +3725,9 @@ static ir_initializer_t *create_ir_initializer(
 
 	case INITIALIZER_DESIGNATOR:
 		panic("unexpected designator initializer");
+
+	case INITIALIZER_BLOB:
+		panic("unexpected blob initializer");
 	}
 	panic("unknown initializer");
 }
@@ -4418,34 +4455,19 @@ static ir_node *for_statement_to_firm(for_statement_t *statement)
 
 static ir_switch_table *create_switch_table(const switch_statement_t *statement)
 {
-	/* determine number of cases */
-	size_t n_cases = 0;
-	for (case_label_statement_t *l = statement->first_case; l != NULL;
-	     l = l->next) {
-		/* default case */
-		if (l->expression == NULL)
-			continue;
-		if (l->is_empty_range)
-			continue;
-		++n_cases;
-	}
-
-	ir_switch_table *res = ir_new_switch_table(current_ir_graph, n_cases);
-	size_t           i   = 0;
-	for (case_label_statement_t *l = statement->first_case; l != NULL;
-	     l = l->next) {
-	    if (l->expression == NULL) {
-			l->pn = pn_Switch_default;
-			continue;
-		}
-		if (l->is_empty_range)
-			continue;
+	/* the parser collected the cases sorted by value */
+	size_t const     n_cases = statement->n_sorted_cases;
+	ir_switch_table *res     = ir_new_switch_table(current_ir_graph, n_cases);
+	for (size_t i = 0; i != n_cases; ++i) {
+		case_label_statement_t *const l = statement->sorted_cases[i];
 		ir_tarval *min = l->first_case;
 		ir_tarval *max = l->last_case;
 		unsigned   pn  = i+1;
-		ir_switch_table_set(res, i++, min, max, pn);
+		ir_switch_table_set(res, i, min, max, pn);
 		l->pn = pn;
 	}
+	if (statement->default_label != NULL)
+		statement->default_label->pn = pn_Switch_default;
 	return res;
 }
 
@@ -4920,6 +4942,8 @@ static void create_function(function_t *const function)
 	if (function->body == NULL)
 		return;
 
+	trace_begin("Construct function", function->base.base.symbol->string);
+
 	ir_entity *const function_entity = get_function_entity(function);
 	if (function->base.modifiers & DM_CONSTRUCTOR) {
 		ir_type *segment = get_segment_type(IR_SEGMENT_CONSTRUCTORS);
@@ -5001,6 +5025,7 @@ static void create_function(function_t *const function)
 	irg_finalize_cons(irg);
 
 	current_function      = old_current_function;
+	trace_end();
 }
 
 static ir_entity *get_irentity(entity_t *entity)
@@ -5159,6 +5184,8 @@ static const char *get_cwd(void)
 
 void translation_unit_to_firm(translation_unit_t *unit)
 {
+	/* function bodies would be missing */
+	assert(!lazy_function_bodies);
 	init_ast2firm();
 	if (dialect.cpp) {
 		be_dwarf_set_source_language(DW_LANG_C_plus_plus);
@@ -16,6 +16,7 @@
 #include <libfirm/firm.h>
 
 #include "firm_opt.h"
+#include "adt/array.h"
 #include "adt/panic.h"
 #include "adt/strutil.h"
 #include "adt/util.h"
@@ -35,6 +36,7 @@ struct a_firm_opt {
 	bool     no_alias;        /**< no aliasing possible. */
 	bool     verify;          /**< Firm verifier setting */
 	bool     check_all;       /**< enable checking all Firm phases */
+	bool     report;          /**< print time and effect of the passes */
 	int      clone_threshold; /**< The threshold value for procedure cloning. */
 	unsigned inline_maxsize;  /**< Maximum function size for inlining. */
 	unsigned inline_threshold;/**< Inlining benefice threshold. */
@@ -124,6 +126,7 @@ static const struct params {
   /* other firm regarding options */
   { X("verify-off"),             &firm_opt.verify,           0, "disable node verification" },
   { X("verify-on"),              &firm_opt.verify,           1, "enable node verification" },
+  { X("opt-report"),             &firm_opt.report,           1, "print time and node count changes of the optimizations" },
 
   /* dumping */
   { X("dump-ir"),                &firm_dump.ir_graph,        1, "dump IR graph" },
@@ -298,6 +301,11 @@ typedef struct {
 	const char   *description;
 	opt_flags_t   flags;
 	ir_timer_t   *timer;
+	/* totals over all runs for -fopt-report */
+	unsigned long report_runs;
+	unsigned long report_usec;
+	unsigned long report_nodes_before;
+	long          report_nodes_removed;
 } opt_config_t;
 
 static opt_config_t *get_opt(const char *name);
@@ -425,6 +433,163 @@ static bool get_opt_enabled(const char *name)
 	return (config->flags & OPT_FLAG_ENABLED) != 0;
 }
 
+static void node_counter(ir_node *node, void *env)
+{
+	(void)node;
+	unsigned long long *count = (unsigned long long*)env;
+	++(*count);
+}
+
+unsigned long long count_firm_nodes(void)
+{
+	unsigned long long count = 0;
+
+	int n_irgs = get_irp_n_irgs();
+	for (int i = 0; i < n_irgs; ++i) {
+		ir_graph *irg = get_irp_irg(i);
+		irg_walk_graph(irg, node_counter, NULL, &count);
+	}
+	return count;
+}
+
+/** a single run of a pass for -fopt-report */
+typedef struct opt_run_t {
+	const opt_config_t *config;
+	const char         *function; /**< NULL for passes on the program */
+	unsigned long       usec;
+	unsigned long       nodes_before;
+	long                nodes_removed;
+} opt_run_t;
+
+typedef struct opt_run_state_t {
+	unsigned long begin_usec;
+	unsigned long transform_usec;
+	unsigned long nodes_before;
+	unsigned long outer_nested_usec;
+	long          outer_nested_nodes;
+} opt_run_state_t;
+
+static ir_timer_t *t_report;
+static opt_run_t  *opt_runs;
+/* Passes may run passes on their own (inlining runs cleanup passes on the
+ * inlined graphs), the time and node changes of these are only accounted
+ * to the inner pass. */
+static unsigned long nested_usec;
+static long          nested_nodes;
+
+static unsigned long report_now(void)
+{
+	ir_timer_stop(t_report);
+	unsigned long const now = ir_timer_elapsed_usec(t_report);
+	ir_timer_start(t_report);
+	return now;
+}
+
+/** Counts the nodes of @p irg, or of the whole program if it is NULL. */
+static unsigned long count_report_nodes(ir_graph *const irg)
+{
+	if (irg == NULL)
+		return count_firm_nodes();
+	unsigned long long count = 0;
+	irg_walk_graph(irg, node_counter, NULL, &count);
+	return count;
+}
+
+static void begin_opt_run(opt_run_state_t *const state, ir_graph *const irg)
+{
+	state->outer_nested_usec  = nested_usec;
+	state->outer_nested_nodes = nested_nodes;
+	nested_usec  = 0;
+	nested_nodes = 0;
+	/* the node counting is not part of the time of the pass */
+	state->begin_usec     = report_now();
+	state->nodes_before   = count_report_nodes(irg);
+	state->transform_usec = report_now();
+}
+
+static void end_opt_run(opt_run_state_t const *const state,
+                        opt_config_t *const config, ir_graph *const irg)
+{
+	unsigned long const end_usec    = report_now();
+	unsigned long const nodes_after = count_report_nodes(irg);
+	long          const delta       = (long)nodes_after - (long)state->nodes_before;
+	opt_run_t     const run         = {
+		.config        = config,
+		.function      = irg != NULL ? get_entity_ld_name(get_irg_entity(irg)) : NULL,
+		.usec          = end_usec - state->transform_usec - nested_usec,
+		.nodes_before  = state->nodes_before,
+		.nodes_removed = nested_nodes - delta,
+	};
+	ARR_APP1(opt_run_t, opt_runs, run);
+
+	++config->report_runs;
+	config->report_usec          += run.usec;
+	config->report_nodes_before  += run.nodes_before;
+	config->report_nodes_removed += run.nodes_removed;
+
+	nested_usec  = state->outer_nested_usec + (report_now() - state->begin_usec);
+	nested_nodes = state->outer_nested_nodes + delta;
+}
+
+static int compare_config_usec(const void *const a, const void *const b)
+{
+	unsigned long const usec_a = (*(opt_config_t const *const*)a)->report_usec;
+	unsigned long const usec_b = (*(opt_config_t const *const*)b)->report_usec;
+	return usec_a < usec_b ? 1 : usec_a > usec_b ? -1 : 0;
+}
+
+static int compare_run_usec(const void *const a, const void *const b)
+{
+	unsigned long const usec_a = ((opt_run_t const*)a)->usec;
+	unsigned long const usec_b = ((opt_run_t const*)b)->usec;
+	return usec_a < usec_b ? 1 : usec_a > usec_b ? -1 : 0;
+}
+
+static double percent(double const part, double const total)
+{
+	return total != 0 ? 100.0 * part / total : 0.0;
+}
+
+static void print_opt_report(FILE *const f)
+{
+	opt_config_t *configs[ARRAY_SIZE(opts)];
+	size_t        n_configs  = 0;
+	unsigned long total_usec = 0;
+	FOR_EACH_OPT(config) {
+		if (config->report_runs == 0)
+			continue;
+		configs[n_configs++] = config;
+		total_usec += config->report_usec;
+	}
+	qsort(configs, n_configs, sizeof(configs[0]), compare_config_usec);
+
+	fprintf(f, "Optimization report: %.3f msec in %lu pass runs\n",
+	        total_usec / 1000.0, (unsigned long)ARR_LEN(opt_runs));
+	fprintf(f, "%-20s %8s %10s %7s %14s %9s\n",
+	        "pass", "runs", "msec", "time", "nodes before", "removed");
+	for (size_t i = 0; i != n_configs; ++i) {
+		opt_config_t const *const config = configs[i];
+		fprintf(f, "%-20s %8lu %10.3f %6.1f%% %14lu %8.2f%%\n",
+		        config->name, config->report_runs,
+		        config->report_usec / 1000.0,
+		        percent(config->report_usec, total_usec),
+		        config->report_nodes_before,
+		        percent(config->report_nodes_removed,
+		                config->report_nodes_before));
+	}
+
+	size_t const n_runs = ARR_LEN(opt_runs);
+	qsort(opt_runs, n_runs, sizeof(opt_runs[0]), compare_run_usec);
+	fputs("Most expensive pass runs:\n", f);
+	for (size_t i = 0; i != n_runs && i != 10; ++i) {
+		opt_run_t const *const run = &opt_runs[i];
+		fprintf(f, "  %-20s %10.3f msec  %8lu -> %8ld nodes  %s\n",
+		        run->config->name, run->usec / 1000.0, run->nodes_before,
+		        (long)run->nodes_before - run->nodes_removed,
+		        run->function != NULL ? run->function : "<program>");
+	}
+}
+
 static void after_transform(ir_graph *irg, const char *name)
 {
 	if (firm_dump.all_phases && firm_dump.ir_graph)
@@ -450,9 +615,16 @@ static bool do_irg_opt(ir_graph *irg, const char *name)
 	if (! (config->flags & OPT_FLAG_ENABLED))
 		return false;
 
+	opt_run_state_t state;
+	if (firm_opt.report)
+		begin_opt_run(&state, irg);
 	timer_start(config->timer);
+	trace_begin(config->name, get_entity_ld_name(get_irg_entity(irg)));
 	config->u.transform_irg(irg);
+	trace_end();
 	timer_stop(config->timer);
+	if (firm_opt.report)
+		end_opt_run(&state, config, irg);
 
 	after_transform(irg, name);
 
@@ -466,9 +638,16 @@ static void do_irp_opt(const char *name)
 	if (! (config->flags & OPT_FLAG_ENABLED))
 		return;
 
+	opt_run_state_t state;
+	if (firm_opt.report)
+		begin_opt_run(&state, NULL);
 	timer_start(config->timer);
+	trace_begin(config->name, NULL);
 	config->u.transform_irp();
+	trace_end();
 	timer_stop(config->timer);
+	if (firm_opt.report)
+		end_opt_run(&state, config, NULL);
 
 	if (firm_dump.ir_graph && firm_dump.all_phases) {
 		for (size_t i = get_irp_n_irgs(); i-- > 0; ) {
@@ -740,6 +919,11 @@ void optimize_lower_ir_prog(void)
 	ir_timer_init_parent(t_verify);
 	ir_timer_init_parent(t_vcg_dump);
 	timer_start(t_all_opt);
+	if (firm_opt.report) {
+		t_report = ir_timer_new();
+		opt_runs = NEW_ARR_F(opt_run_t, 0);
+		ir_timer_reset_and_start(t_report);
+	}
 
 	dump_types("types.vcg");
 	dump_all("");
@@ -755,6 +939,11 @@ void optimize_lower_ir_prog(void)
 	dump_types("types-low.vcg");
 
 	timer_stop(t_all_opt);
+	if (firm_opt.report) {
+		print_opt_report(stderr);
+		DEL_ARR_F(opt_runs);
+		ir_timer_free(t_report);
+	}
 }
 
 /**
@@ -770,11 +959,15 @@ void generate_code(FILE *out, const char *input_filename)
 	if (experimental)
 		warningf(WARN_EXPERIMENTAL, NULL, "%s", experimental);
 
+	trace_begin("Optimize", NULL);
 	optimize_lower_ir_prog();
+	trace_end();
 
 	/* run the code generator */
 	timer_start(t_backend);
+	trace_begin("Backend", NULL);
 	be_main(out, input_filename);
+	trace_end();
 	timer_stop(t_backend);
 }
 
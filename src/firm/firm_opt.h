@@ -130,6 +130,9 @@ void optimize_lower_ir_prog(void);
 
 bool firm_is_inlining_enabled(void);
 
+/** Returns the number of nodes reachable in all graphs of the program. */
+unsigned long long count_firm_nodes(void);
+
 typedef void (*print_option_help_func)(const char *name, const char *description);
 
 void firm_option_help(print_option_help_func func);
@@ -178,14 +178,17 @@ static void set_handlers(compile_mode_t mode)
 	case MODE_PRINT_FLUFFY:
 		set_unit_handler(COMPILATION_UNIT_AST, print_fluffy, true);
 		set_unused_after(MODE_PARSE_ONLY);
+		lazy_function_bodies = true;
 		return;
 	case MODE_PRINT_JNA:
 		set_unit_handler(COMPILATION_UNIT_AST, print_jna, true);
 		set_unused_after(MODE_PARSE_ONLY);
+		lazy_function_bodies = true;
 		return;
 	case MODE_PRINT_COMPOUND_SIZE:
 		set_unit_handler(COMPILATION_UNIT_AST, print_compound_size, true);
 		set_unused_after(MODE_PARSE_ONLY);
+		lazy_function_bodies = true;
 		return;
 	case MODE_PARSE_ONLY:
 	case MODE_COMPILE_DUMP:
@@ -270,6 +273,18 @@ static bool parse_compile_mode_options(options_state_t *s)
 	return true;
 }
 
+static void write_time_trace(void)
+{
+	FILE *const out = fopen(time_trace_file, "w");
+	if (out == NULL) {
+		errorf(NULL, "Opening trace file '%s' failed: %s", time_trace_file,
+		       strerror(errno));
+	}
+	trace_term(out);
+	if (out != NULL)
+		fclose(out);
+}
+
 int action_compile(const char *argv0)
 {
 	(void)argv0;
@@ -278,6 +293,8 @@ int action_compile(const char *argv0)
 	begin_statistics();
 	if (do_timing)
 		timer_init();
+	if (time_trace_file != NULL)
+		trace_init(time_trace_granularity);
 
 	compilation_env_t env;
 	memset(&env, 0, sizeof(env));
@@ -302,6 +319,8 @@ int action_compile(const char *argv0)
 
 	if (do_timing)
 		timer_term(print_timing ? stderr : NULL);
+	if (time_trace_file != NULL)
+		write_time_trace();
 	end_statistics();
 	return result;
 }
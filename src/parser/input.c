@@ -2,13 +2,18 @@
  * This file is part of cparser.
  * Copyright (C) 2012 Matthias Braun <matze@braunis.de>
  */
+#include "driver/enable_posix.h"
 #include "input.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <string.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
+#include "adt/obst.h"
 #include "adt/util.h"
 #include "adt/xmalloc.h"
 
@@ -16,15 +21,23 @@ typedef size_t (*decode_func)(input_t *input, utf32 *buffer, size_t buffer_size)
 
 typedef enum {
 	INPUT_FILE,
+	INPUT_MMAP,
 	INPUT_STRING
 } input_kind_t;
 
 struct input_t {
-	input_kind_t kind;
-	union {
-		FILE *file;
-		const char *string;
-	} in;
+	input_kind_t     kind;
+	/** the underlying stream (INPUT_FILE and INPUT_MMAP) */
+	FILE            *file;
+	/** read position and end of the data (INPUT_MMAP and INPUT_STRING) */
+	const char      *pos;
+	const char      *end;
+	/** the mapped file contents (INPUT_MMAP) */
+	void            *map;
+	size_t           map_size;
+	/** holds the input contents if they had to be read or converted */
+	struct obstack   obst;
+	bool             obst_used;
 	input_decoder_t *decoder;
 
 	/* state for utf-8 decoder */
@@ -44,7 +57,7 @@ static size_t read_block(input_t *input, unsigned char *const read_buf,
                          size_t const n)
 {
 	if (input->kind == INPUT_FILE) {
-		FILE *file = input->in.file;
+		FILE *file = input->file;
 		size_t const s = fread(read_buf, 1, n, file);
 		if (s == 0) {
 			/* on OS/X ferror appears to return true on eof as well when running
@@ -55,11 +68,11 @@ static size_t read_block(input_t *input, unsigned char *const read_buf,
 		}
 		return s;
 	} else {
-		assert(input->kind == INPUT_STRING);
-		size_t len = strlen(input->in.string);
+		assert(input->kind == INPUT_MMAP || input->kind == INPUT_STRING);
+		size_t len = input->end - input->pos;
 		len = MIN(len, n);
-		memcpy(read_buf, input->in.string, len);
-		input->in.string += len;
+		memcpy(read_buf, input->pos, len);
+		input->pos += len;
 		return len;
 	}
 }
@@ -336,31 +349,190 @@ input_decoder_t *input_get_decoder(const char *encoding)
 	return NULL;
 }
 
+/**
+ * Try to map the whole file underlying a stream into memory. The input is left
+ * unchanged if this is not possible (pipes, terminals, empty files, ...).
+ *
+ * @param terminated  whether the mapped contents must be followed by a '\0'
+ */
+static void map_file(input_t *const input, bool const terminated)
+{
+#ifdef HAVE_MMAP
+	FILE *const file = input->file;
+	int   const fd   = fileno(file);
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || ftell(file) != 0)
+		return;
+
+	/* We rely on the zero filled rest of the last page to terminate the
+	 * input, so files ending exactly at a page boundary are read instead. */
+	size_t const size      = st.st_size;
+	long   const page_size = sysconf(_SC_PAGESIZE);
+	if (size == 0 || (off_t)size != st.st_size || page_size <= 0
+	 || (terminated && size % (size_t)page_size == 0))
+		return;
+
+	void *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return;
+	input->kind     = INPUT_MMAP;
+	input->map      = map;
+	input->map_size = size;
+	input->pos      = (const char*)map;
+	input->end      = input->pos + size;
+#else
+	(void)input;
+	(void)terminated;
+#endif
+}
+
 input_t *input_from_stream(FILE *file, input_decoder_t *decoder)
 {
 	input_t *result = XMALLOCZ(input_t);
 	result->kind    = INPUT_FILE;
-	result->in.file = file;
+	result->file    = file;
 	result->decoder = decoder;
+	map_file(result, true);
+	return result;
+}
+
+input_t *input_from_binary_stream(FILE *file)
+{
+	input_t *result = XMALLOCZ(input_t);
+	result->kind    = INPUT_FILE;
+	result->file    = file;
+	map_file(result, false);
 	return result;
 }
 
 FILE *input_get_file(const input_t *const input)
 {
-	if (input->kind != INPUT_FILE)
+	if (input->kind == INPUT_STRING)
 		return NULL;
-	return input->in.file;
+	return input->file;
 }
 
 input_t *input_from_string(const char *string, input_decoder_t *decoder)
 {
-	input_t *result   = XMALLOCZ(input_t);
-	result->kind      = INPUT_STRING;
-	result->in.string = string;
-	result->decoder   = decoder;
+	input_t *result = XMALLOCZ(input_t);
+	result->kind    = INPUT_STRING;
+	result->pos     = string;
+	result->end     = string + strlen(string);
+	result->decoder = decoder;
 	return result;
 }
 
+void input_get_utf8(input_t *const input, const char **const begin,
+                    const char **const end)
+{
+	if (input->decoder == input_decode_utf8 && input->kind != INPUT_FILE) {
+		/* use mapped files and strings in place */
+		*begin     = input->pos;
+		*end       = input->end;
+		input->pos = input->end;
+		return;
+	}
+
+	assert(!input->obst_used);
+	obstack_init(&input->obst);
+	input->obst_used = true;
+	if (input->decoder == input_decode_utf8) {
+		/* the bytes are validated by input_read_utf8_char() */
+		unsigned char read_buf[4096];
+		size_t        s;
+		while ((s = read_block(input, read_buf, sizeof(read_buf))) != 0) {
+			obstack_grow(&input->obst, read_buf, s);
+		}
+	} else {
+		utf32  buf[1024];
+		size_t n;
+		while ((n = decode(input, buf, ARRAY_SIZE(buf))) != 0) {
+			for (size_t i = 0; i != n; ++i) {
+				obstack_grow_utf8(&input->obst, buf[i]);
+			}
+		}
+	}
+	size_t const size = obstack_object_size(&input->obst);
+	obstack_1grow(&input->obst, '\0');
+	*begin = (const char*)obstack_finish(&input->obst);
+	*end   = *begin + size;
+}
+
+void input_get_bytes(input_t *const input, const unsigned char **const begin,
+                     size_t *const size)
+{
+	if (input->kind != INPUT_FILE) {
+		*begin     = (const unsigned char*)input->pos;
+		*size      = input->end - input->pos;
+		input->pos = input->end;
+		return;
+	}
+
+	assert(!input->obst_used);
+	obstack_init(&input->obst);
+	input->obst_used = true;
+	unsigned char read_buf[4096];
+	size_t        s;
+	while ((s = read_block(input, read_buf, sizeof(read_buf))) != 0) {
+		obstack_grow(&input->obst, read_buf, s);
+	}
+	*size  = obstack_object_size(&input->obst);
+	*begin = (const unsigned char*)obstack_finish(&input->obst);
+}
+
+utf32 input_read_utf8_char(const char **const p)
+{
+	unsigned char const *src = (unsigned char const*)*p;
+	utf32                decoded;
+	utf32                min_code;
+	unsigned             n_more;
+	if ((*src & 0x80) == 0) {
+		*p = (const char*)(src + 1);
+		return *src;
+	} else if ((*src & 0xE0) == 0xC0) {
+		min_code = 0x80;
+		decoded  = *src & 0x1F;
+		n_more   = 1;
+	} else if ((*src & 0xF0) == 0xE0) {
+		min_code = 0x800;
+		decoded  = *src & 0x0F;
+		n_more   = 2;
+	} else if ((*src & 0xF8) == 0xF0) {
+		min_code = 0x10000;
+		decoded  = *src & 0x07;
+		n_more   = 3;
+	} else {
+		/* skip to the start of the next character */
+		do {
+			++src;
+		} while ((*src & 0xC0) == 0x80 || (*src & 0xF8) == 0xF8);
+		goto invalid;
+	}
+
+	++src;
+	for (; n_more != 0; --n_more) {
+		/* the terminating '\0' is no continuation byte, so we cannot read past
+		 * the end of the input here */
+		if ((*src & 0xC0) != 0x80)
+			goto invalid;
+		decoded = (decoded << 6) | (*src++ & 0x3F);
+	}
+	if (decoded < min_code                      ||
+	    decoded > 0x10FFFF                      ||
+	    (0xD800 <= decoded && decoded < 0xE000) || // high/low surrogates
+	    (0xFDD0 <= decoded && decoded < 0xFDF0) || // noncharacters
+	    (decoded & 0xFFFE) == 0xFFFE) {            // noncharacters
+		goto invalid;
+	}
+	*p = (const char*)src;
+	return decoded;
+
+invalid:
+	input_error(0, 0, "invalid byte sequence in input");
+	*p = (const char*)src;
+	return UNICODE_REPLACEMENT_CHARACTER;
+}
+
 size_t decode(input_t *input, utf32 *buffer, size_t buffer_size)
 {
 	return input->decoder(input, buffer, buffer_size);
@@ -368,5 +540,11 @@ size_t decode(input_t *input, utf32 *buffer, size_t buffer_size)
 
 void input_free(input_t *input)
 {
+#ifdef HAVE_MMAP
+	if (input->kind == INPUT_MMAP)
+		munmap(input->map, input->map_size);
+#endif
+	if (input->obst_used)
+		obstack_free(&input->obst, NULL);
 	free(input);
 }
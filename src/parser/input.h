@@ -16,12 +16,45 @@ input_decoder_t *input_get_decoder(const char *encoding);
 
 input_t *input_from_stream(FILE *stream, input_decoder_t *decoder);
 input_t *input_from_string(const char *string, input_decoder_t *decoder);
+/** Creates an input reading the bytes of @p stream without decoding them. */
+input_t *input_from_binary_stream(FILE *stream);
 
 input_decoder_t input_decode_utf8;
 
 /** return underlying FILE* of an input if available, else NULL */
 FILE *input_get_file(const input_t *input);
 
+/**
+ * Returns the complete contents of an input as utf-8 encoded bytes. Mapped
+ * files and strings are returned in place, other inputs are read (and
+ * converted) into a buffer owned by the input. The range is always followed
+ * by a '\0' byte, the bytes themselves are not validated yet: Use
+ * input_read_utf8_char() for non-ASCII characters.
+ *
+ * @param begin  is set to the first byte of the input
+ * @param end    is set to the end of the input, *end is '\0'
+ */
+void input_get_utf8(input_t *input, const char **begin, const char **end);
+
+/**
+ * Returns the complete contents of an input created by
+ * input_from_binary_stream(). Mapped files are returned in place, other inputs
+ * are read into a buffer owned by the input.
+ */
+void input_get_bytes(input_t *input, const unsigned char **begin,
+                     size_t *size);
+
+/**
+ * Decodes a single utf-8 encoded character and reports invalid byte sequences
+ * through the input error callback (the unicode replacement character is
+ * returned for them). Must only be used on '\0' terminated ranges, for example
+ * ones returned by input_get_utf8().
+ *
+ * @param p  A pointer to a pointer into the bytes. The pointer is advanced
+ *           past the consumed bytes.
+ */
+utf32 input_read_utf8_char(const char **p);
+
 /** Type for a function being called on an input (or encoding) errors. */
 typedef void (*input_error_callback_func)(unsigned delta_lines,
                                           unsigned delta_cols,
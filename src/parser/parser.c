@@ -28,6 +28,7 @@
 #include "ast/walk.h"
 #include "builtins.h"
 #include "driver/diagnostic.h"
+#include "driver/timing.h"
 #include "driver/warning.h"
 #include "format_check.h"
 #include "preprocessor.h"
@@ -72,6 +73,11 @@ static token_t              token;
 static token_t              lookahead_buffer[MAX_LOOKAHEAD];
 /** Position of the next token in the lookahead buffer. */
 static size_t               lookahead_bufpos;
+/** Tokens put in front of the lookahead buffer, the next one comes last. */
+static token_t              pushed_tokens[2];
+static size_t               n_pushed_tokens;
+/** the number tokens for the bytes of #embed data, created when needed */
+static string_t            *byte_strings[256];
 static stack_entry_t       *environment_stack = NULL;
 static stack_entry_t       *label_stack       = NULL;
 static scope_t             *file_scope        = NULL;
@@ -98,6 +104,8 @@ static elf_visibility_t     default_visibility = ELF_VISIBILITY_DEFAULT;
 static const string_t      *string_true;
 static const string_t      *string_false;
 
+bool                        lazy_function_bodies;
+
 #define PUSH_CURRENT_ENTITY(entity) \
 	entity_t *const new_current_entity = (entity); \
 	entity_t *const old_current_entity = current_entity; \
@@ -243,6 +251,7 @@ static void semantic_comparison(binary_expression_t *expression,
 	case '~':                         \
 	case T_ANDAND:                    \
 	case T_CHARACTER_CONSTANT:        \
+	case T_EMBED:                     \
 	case T_NUMBER:                    \
 	case T_MINUSMINUS:                \
 	case T_PLUSPLUS:                  \
@@ -422,7 +431,8 @@ static size_t get_initializer_size(initializer_kind_t kind)
 		[INITIALIZER_VALUE]      = sizeof(initializer_value_t),
 		[INITIALIZER_STRING]     = sizeof(initializer_value_t),
 		[INITIALIZER_LIST]       = sizeof(initializer_list_t),
-		[INITIALIZER_DESIGNATOR] = sizeof(initializer_designator_t)
+		[INITIALIZER_DESIGNATOR] = sizeof(initializer_designator_t),
+		[INITIALIZER_BLOB]       = sizeof(initializer_blob_t)
 	};
 	assert((size_t)kind < ARRAY_SIZE(sizes));
 	assert(sizes[kind] != 0);
@@ -476,6 +486,11 @@ static size_t label_top(void)
  */
 static inline void next_token(void)
 {
+	if (UNLIKELY(n_pushed_tokens != 0)) {
+		token = pushed_tokens[--n_pushed_tokens];
+		return;
+	}
+
 	token                              = lookahead_buffer[lookahead_bufpos];
 	lookahead_buffer[lookahead_bufpos] = pp_token;
 	next_preprocessing_token();
@@ -512,6 +527,11 @@ static inline bool accept(token_kind_t const kind)
 static inline const token_t *look_ahead(size_t num)
 {
 	assert(0 < num && num <= MAX_LOOKAHEAD);
+	if (UNLIKELY(n_pushed_tokens != 0)) {
+		if (num <= n_pushed_tokens)
+			return &pushed_tokens[n_pushed_tokens - num];
+		num -= n_pushed_tokens;
+	}
 	size_t pos = (lookahead_bufpos + num - 1) % MAX_LOOKAHEAD;
 	return &lookahead_buffer[pos];
 }
@@ -521,6 +541,45 @@ static inline bool peek_ahead(token_kind_t const kind)
 	return look_ahead(1)->kind == kind;
 }
 
+/**
+ * Replaces the #embed data in the current token by a number for its first
+ * byte, followed by ',' and the remaining data. This is only needed where the
+ * data does not initialize an array as a whole.
+ */
+static void split_embed_token(void)
+{
+	assert(n_pushed_tokens == 0);
+	resource_t const *const resource = token.embed.resource;
+	unsigned char     const byte     = resource->data[0];
+	if (resource->size > 1) {
+		resource_t *const rest = obstack_alloc(&ast_obstack, sizeof(*rest));
+		rest->data = resource->data + 1;
+		rest->size = resource->size - 1;
+
+		token_t *const data = &pushed_tokens[0];
+		*data                   = token;
+		data->base.space_before = false;
+		data->embed.resource    = rest;
+
+		token_t *const comma = &pushed_tokens[1];
+		*comma             = (token_t){ .kind = ',' };
+		comma->base.pos    = token.base.pos;
+		comma->base.symbol = token_symbols[','];
+		n_pushed_tokens = 2;
+	}
+
+	string_t *string = byte_strings[byte];
+	if (string == NULL) {
+		char buf[4];
+		snprintf(buf, sizeof(buf), "%u", (unsigned)byte);
+		string = make_string(buf);
+		byte_strings[byte] = string;
+	}
+	token.kind           = T_NUMBER;
+	token.base.symbol    = NULL;
+	token.literal.string = string;
+}
+
 /**
  * Adds a token type to the token type anchor set (a multi-set).
  */
@@ -797,7 +856,7 @@ static void stack_push(stack_entry_t **stack_ptr, entity_t *entity)
  */
 static void environment_push(entity_t *entity)
 {
-	assert(entity->base.pos.input_name != NULL);
+	assert(entity->base.pos.offset != 0);
 	assert(entity->base.parent_scope != NULL);
 	stack_push(&environment_stack, entity);
 }
@@ -1889,6 +1948,206 @@ static void skip_initializers(void)
 	}
 }
 
+/**
+ * Number of consecutive constant array elements from which on they are packed
+ * into a blob initializer.
+ */
+#define INITIALIZER_BLOB_THRESHOLD 16
+
+/** A run of constant array elements packed into a blob initializer. */
+typedef struct blob_builder_t {
+	type_t        *element_type; /**< NULL if no run is being packed */
+	ir_mode       *mode;
+	position_t     pos;
+	size_t         len;
+	unsigned char *data;         /**< the packed elements, a flexible array */
+} blob_builder_t;
+
+/**
+ * Tests whether @p sub initializes the current element of the array at the
+ * top of @p path with a constant of real type, so it can be packed into a blob.
+ */
+static bool is_blob_element(type_path_t const *const path,
+                            size_t const top_path_level,
+                            initializer_t const *const sub)
+{
+	if (sub->kind != INITIALIZER_VALUE)
+		return false;
+	if (ARR_LEN(path->path) != top_path_level
+	 || !is_type_array(skip_typeref(path->path[top_path_level - 1].type)))
+		return false;
+	if (!is_type_real(skip_typeref(path->top_type)))
+		return false;
+	return is_constant_expression(sub->value.value) >= EXPR_CLASS_CONSTANT;
+}
+
+/**
+ * Tests whether @p expression is a literal with an optional sign and implicit
+ * conversions. Parsing it allocated nothing else, so it can be freed again.
+ */
+static bool is_plain_literal(expression_t const *expression)
+{
+	for (;;) {
+		switch (expression->kind) {
+		case EXPR_UNARY_CAST:
+			if (!expression->base.implicit)
+				return false;
+			/* FALLTHROUGH */
+		case EXPR_UNARY_PLUS:
+		case EXPR_UNARY_NEGATE:
+			expression = expression->unary.value;
+			continue;
+
+		case EXPR_LITERAL_CASES:
+		case EXPR_LITERAL_CHARACTER:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+}
+
+static void append_blob_element(blob_builder_t *const blob,
+                                initializer_t const *const sub)
+{
+	ir_tarval *const value = fold_expression(sub->value.value);
+	ir_tarval *const tv    = tarval_convert_to(value, blob->mode);
+	size_t     const size  = get_mode_size_bytes(blob->mode);
+	ARR_EXTEND(unsigned char, blob->data, size);
+	tarval_to_bytes(&blob->data[ARR_LEN(blob->data) - size], tv);
+	++blob->len;
+}
+
+/**
+ * Moves the last INITIALIZER_BLOB_THRESHOLD entries of @p initializers into
+ * @p blob, further elements of the run are appended to it directly.
+ */
+static void start_blob(blob_builder_t *const blob, type_t *const element_type,
+                       initializer_t ***const initializers)
+{
+	initializer_t **const inits = *initializers;
+	size_t          const begin = ARR_LEN(inits) - INITIALIZER_BLOB_THRESHOLD;
+	blob->element_type = element_type;
+	blob->mode         = get_ir_mode_storage(element_type);
+	blob->pos          = inits[begin]->base.pos;
+	blob->len          = 0;
+	if (blob->data == NULL)
+		blob->data = NEW_ARR_F(unsigned char, 0);
+	ARR_SHRINKLEN(blob->data, 0);
+	for (size_t i = begin; i != ARR_LEN(inits); ++i)
+		append_blob_element(blob, inits[i]);
+	ARR_SHRINKLEN(*initializers, begin);
+}
+
+/** Ends the run packed in @p blob and appends its blob initializer. */
+static void finish_blob(blob_builder_t *const blob,
+                        initializer_t ***const initializers)
+{
+	if (blob->element_type == NULL)
+		return;
+
+	size_t const   size   = ARR_LEN(blob->data);
+	initializer_t *result
+		= allocate_ast_zero(sizeof(initializer_blob_t) + size);
+	unsigned char *const data = (unsigned char*)(&result->blob + 1);
+	memcpy(data, blob->data, size);
+	result->kind              = INITIALIZER_BLOB;
+	result->base.pos          = blob->pos;
+	result->blob.element_type = blob->element_type;
+	result->blob.len          = blob->len;
+	result->blob.data         = data;
+	ARR_APP1(initializer_t*, *initializers, result);
+
+	blob->element_type = NULL;
+}
+
+/**
+ * Tests whether the current token is #embed data initializing elements of the
+ * array at the top of @p path.
+ */
+static bool is_embed_initializer(type_path_t const *const path,
+                                 size_t const top_path_level,
+                                 type_t const *const type)
+{
+	return peek(T_EMBED) && type != NULL && is_type_real(type)
+	    && ARR_LEN(path->path) == top_path_level
+	    && is_type_array(skip_typeref(path->path[top_path_level - 1].type));
+}
+
+/**
+ * Initializes consecutive elements of the array at the top of @p path with
+ * the bytes of the #embed data in the current token. Byte elements refer to
+ * the data directly instead of copying it.
+ */
+static void parse_embed_initializer(blob_builder_t *const blob,
+                                    type_path_t *const path,
+                                    size_t const top_path_level,
+                                    initializer_t ***const initializers,
+                                    parse_initializer_env_t const *const env)
+{
+	resource_t const *const resource = token.embed.resource;
+	position_t const *const pos      = HERE;
+	type_path_entry_t *const top     = &path->path[top_path_level - 1];
+	type_t            *const array   = skip_typeref(top->type);
+	size_t                   len     = resource->size;
+	if (array->array.size_constant && array->array.size - top->v.index < len) {
+		len = array->array.size - top->v.index;
+		if (env->entity != NULL) {
+			warningf(WARN_OTHER, pos, "excess elements in initializer for %N",
+			         env->entity);
+		} else {
+			warningf(WARN_OTHER, pos, "excess elements in initializer");
+		}
+	}
+
+	finish_blob(blob, initializers);
+	type_t *const element_type = path->top_type;
+	type_t *const type         = skip_typeref(element_type);
+	ir_mode *const mode        = get_ir_mode_storage(element_type);
+	if (is_type_integer(type) && !is_type_atomic(type, ATOMIC_TYPE_BOOL)
+	 && get_mode_size_bytes(mode) == 1) {
+		initializer_t *const result
+			= allocate_initializer_zero(INITIALIZER_BLOB, pos);
+		result->blob.element_type = element_type;
+		result->blob.len          = len;
+		result->blob.data         = resource->data;
+		ARR_APP1(initializer_t*, *initializers, result);
+	} else {
+		blob->element_type = element_type;
+		blob->mode         = mode;
+		blob->pos          = *pos;
+		blob->len          = len;
+		if (blob->data == NULL)
+			blob->data = NEW_ARR_F(unsigned char, 0);
+		ARR_SHRINKLEN(blob->data, 0);
+		ir_mode *const byte_mode = get_ir_mode_storage(type_unsigned_char);
+		size_t   const size      = get_mode_size_bytes(mode);
+		bool     const is_bool   = is_type_atomic(type, ATOMIC_TYPE_BOOL);
+		for (size_t i = 0; i != len; ++i) {
+			unsigned char const byte = resource->data[i];
+			ir_tarval          *value;
+			if (is_bool) {
+				/* any non-zero byte converts to 1 */
+				value = byte != 0 ? get_mode_one(mode) : get_mode_null(mode);
+			} else {
+				value = tarval_convert_to(new_tarval_from_long(byte, byte_mode),
+				                          mode);
+			}
+			ARR_EXTEND(unsigned char, blob->data, size);
+			tarval_to_bytes(&blob->data[ARR_LEN(blob->data) - size], value);
+		}
+		finish_blob(blob, initializers);
+	}
+	eat(T_EMBED);
+
+	top->v.index += len - 1;
+	type_path_entry_t const *const first      = &path->path[0];
+	type_t                  *const first_type = skip_typeref(first->type);
+	if (is_type_array(first_type))
+		path->size = MAX(path->size, first->v.index + 1);
+}
+
 /**
  * Parse a part of an initialiser for a struct or union,
  */
@@ -1913,6 +2172,12 @@ static initializer_t *parse_sub_initializer(type_path_t *path,
 	size_t top_path_level = ARR_LEN(path->path);
 	initializer_t **initializers = NEW_ARR_F(initializer_t*, 0);
 
+	/* runs of constant array elements are packed into blobs, run_begin is
+	 * the first entry of the current run in initializers */
+	blob_builder_t blob;
+	memset(&blob, 0, sizeof(blob));
+	size_t run_begin = 0;
+
 	while (true) {
 		designator_t *designator = NULL;
 		if (peek('.') || peek('[')) {
@@ -1939,15 +2204,25 @@ finish_designator:
 			initializer_t *designator_initializer
 				= allocate_initializer_zero(INITIALIZER_DESIGNATOR, pos);
 			designator_initializer->designator.designator = designator;
+			finish_blob(&blob, &initializers);
 			ARR_APP1(initializer_t*, initializers, designator_initializer);
+			run_begin = ARR_LEN(initializers);
 
 			orig_type = path->top_type;
 			type      = orig_type != NULL ? skip_typeref(orig_type) : NULL;
 		}
 
 		initializer_t *sub;
-
-		if (peek('{')) {
+		/* everything allocated for the element begins here if it is an
+		 * expression */
+		void          *element_mark = NULL;
+
+		if (is_embed_initializer(path, top_path_level, type)) {
+			parse_embed_initializer(&blob, path, top_path_level, &initializers,
+			                        env);
+			run_begin = ARR_LEN(initializers);
+			goto error_parse_next;
+		} else if (peek('{')) {
 			if (type != NULL && is_type_scalar(type)) {
 				sub = parse_scalar_initializer(type, env->must_be_constant, false);
 			} else {
@@ -1978,6 +2253,7 @@ finish_designator:
 			}
 		} else {
 			/* must be an expression */
+			element_mark = obstack_alloc(&ast_obstack, 0);
 			expression_t *expression = parse_assignment_expression();
 			mark_vars_read(expression, NULL);
 
@@ -2053,7 +2329,22 @@ excess_elements:;
 			path->size = MAX(path->size, first->v.index + 1);
 
 		/* append to initializers list */
-		ARR_APP1(initializer_t*, initializers, sub);
+		if (!is_blob_element(path, top_path_level, sub)) {
+			finish_blob(&blob, &initializers);
+			ARR_APP1(initializer_t*, initializers, sub);
+			run_begin = ARR_LEN(initializers);
+		} else if (blob.element_type != NULL) {
+			append_blob_element(&blob, sub);
+			/* nothing refers to the element anymore, unless it split #embed
+			 * data whose rest is still to be parsed */
+			if (element_mark != NULL && is_plain_literal(sub->value.value)
+			 && n_pushed_tokens == 0 && !peek(T_EMBED))
+				obstack_free(&ast_obstack, element_mark);
+		} else {
+			ARR_APP1(initializer_t*, initializers, sub);
+			if (ARR_LEN(initializers) - run_begin == INITIALIZER_BLOB_THRESHOLD)
+				start_blob(&blob, path->top_type, &initializers);
+		}
 
 error_parse_next:
 		if (!accept(','))
@@ -2072,6 +2363,7 @@ error_parse_next:
 		}
 	}
 
+	finish_blob(&blob, &initializers);
 	size_t const len = ARR_LEN(initializers);
 	result = allocate_initializer_list(len, &env->pos);
 	memcpy(&result->list.initializers, initializers,
@@ -2083,6 +2375,8 @@ end_error:
 	if (result == NULL)
 		result = allocate_initializer_list(0, &env->pos);
 out:
+	if (blob.data != NULL)
+		DEL_ARR_F(blob.data);
 	DEL_ARR_F(initializers);
 	ascend_to(path, top_path_level+1);
 	return result;
@@ -2221,6 +2515,8 @@ static type_t *parse_compound_type_specifier(bool const is_struct)
 				note_prev_decl(entity);
 				/* clear members in the hope to avoid further errors */
 				entity->compound.members.first_entity = NULL;
+				entity->compound.members.index        = NULL;
+				entity->compound.member_index         = NULL;
 			}
 		}
 	} else if (!peek('{')) {
@@ -4054,7 +4350,8 @@ entity_t *record_entity(entity_t *entity, const bool is_definition)
 						goto finish;
 				} else {
 					/* GCC extension: redef in system headers is allowed */
-					if ((pos->is_system_header || previous->base.pos.is_system_header)
+					if ((is_system_header_position(pos)
+					  || is_system_header_position(&previous->base.pos))
 					 && types_same(type, prev_type))
 						goto finish;
 				}
@@ -4763,6 +5060,7 @@ static bool initializer_returns(initializer_t const *const init)
 
 	case INITIALIZER_STRING:
 	case INITIALIZER_DESIGNATOR: // designators have no payload
+	case INITIALIZER_BLOB:
 		return true;
 	}
 	panic("unhandled initializer");
@@ -5184,6 +5482,8 @@ warn_unreachable:
 }
 
 static void prepare_main_collect2(entity_t *entity);
+static void skip_function_body(function_t *function);
+static void parse_function_body(entity_t *entity);
 
 static void parse_external_declaration(int using_inference)
 {
@@ -5309,28 +5609,70 @@ static void parse_external_declaration(int using_inference)
 	if (ndeclaration != entity)
 		function->parameters = ndeclaration->function.parameters;
 
-	PUSH_SCOPE(&function->parameters);
-
 	for (entity_t *parameter = function->parameters.first_entity;
 	     parameter != NULL; parameter = parameter->base.next) {
 		if (parameter->base.parent_scope == &ndeclaration->function.parameters)
-			parameter->base.parent_scope = current_scope;
+			parameter->base.parent_scope = &function->parameters;
 
 		assert(parameter->base.parent_scope == NULL
-		       || parameter->base.parent_scope == current_scope);
-		parameter->base.parent_scope = current_scope;
-		if (parameter->base.symbol == NULL) {
+		       || parameter->base.parent_scope == &function->parameters);
+		parameter->base.parent_scope = &function->parameters;
+		if (parameter->base.symbol == NULL)
 			errorf(&parameter->base.pos, "parameter name omitted");
-			continue;
-		}
-		environment_push(parameter);
 	}
 
 	/* we have a fresh function. If there was a previous definition
 	 * record_entity() reported the error and returned the fresh one. */
 	assert(function->body == NULL);
 
-	/* parse function body */
+	if (lazy_function_bodies && current_scope == file_scope
+	 && !is_main(entity)) {
+		skip_function_body(function);
+	} else {
+		parse_function_body(entity);
+	}
+}
+
+/**
+ * Skips the body of @p function without parsing it, the body becomes an empty
+ * compound statement.
+ */
+static void skip_function_body(function_t *const function)
+{
+	statement_t *const body = allocate_statement_zero(STATEMENT_COMPOUND);
+	body->base.pos = *HERE;
+
+	unsigned depth = 0;
+	do {
+		if (peek(T_EOF)) {
+			parse_error_expected("function body", '}', NULL);
+			break;
+		}
+		if (peek('{')) {
+			++depth;
+		} else if (peek('}')) {
+			--depth;
+		}
+		next_token();
+	} while (depth != 0);
+
+	function->body = body;
+}
+
+/**
+ * Parses the body of function @p entity, the current token is its '{'.
+ */
+static void parse_function_body(entity_t *const entity)
+{
+	function_t *const function = &entity->function;
+	PUSH_SCOPE(&function->parameters);
+
+	for (entity_t *parameter = function->parameters.first_entity;
+	     parameter != NULL; parameter = parameter->base.next) {
+		if (parameter->base.symbol != NULL)
+			environment_push(parameter);
+	}
+
 	int         label_stack_top      = label_top();
 	function_t *old_current_function = current_function;
 	current_function                 = function;
@@ -6003,28 +6345,21 @@ type_t *automatic_type_conversion(type_t *orig_type)
  * Find an entity matching a symbol in a scope.
  * Uses current scope if scope is NULL
  */
-static entity_t *lookup_entity(const scope_t *scope, symbol_t *symbol,
+static entity_t *lookup_entity(scope_t *scope, symbol_t *symbol,
                                entity_namespace_t namespc)
 {
 	if (scope == NULL)
 		return get_entity(symbol, namespc);
 
-	/* we should optimize here, if scope grows above a certain size we should
-	   construct a hashmap here... */
-	for (entity_t *entity = scope->first_entity; entity != NULL;
-	     entity = entity->base.next) {
-		if (entity->base.symbol == symbol && entity->base.namespc == namespc)
-			return entity;
-	}
-	return NULL;
+	return find_scope_entity(scope, symbol, namespc);
 }
 
 static entity_t *parse_qualified_identifier(void)
 {
 	/* namespace containing the symbol */
-	symbol_t      *symbol;
-	position_t     pos;
-	const scope_t *lookup_scope = NULL;
+	symbol_t   *symbol;
+	position_t  pos;
+	scope_t    *lookup_scope = NULL;
 
 	if (accept(T_COLONCOLON))
 		lookup_scope = &unit->scope;
@@ -6747,6 +7082,9 @@ static expression_t *parse_primary_expression(void)
 	case T_false:                        return parse_boolean_literal(false);
 	case T_true:                         return parse_boolean_literal(true);
 	case T_NUMBER:                       return parse_number_literal();
+	case T_EMBED:
+		split_embed_token();
+		return parse_number_literal();
 	case T_CHARACTER_CONSTANT:           return parse_character_constant();
 	case T_STRING_LITERAL:               return parse_string_literal();
 	case T___func__:                     return parse_function_keyword(FUNCNAME_FUNCTION);
@@ -8637,9 +8975,7 @@ static bool is_ambiguous_unary_expression_kind(expression_kind_t expression_kind
 static bool are_positions_contiguous(const position_t *pos_first,
                                      const position_t *pos_second)
 {
-	return pos_first->colno + 1  == pos_second->colno
-	    && pos_first->lineno     == pos_second->lineno
-	    && pos_first->input_name == pos_second->input_name;
+	return pos_first->offset + 1 == pos_second->offset;
 }
 
 /**
@@ -9296,7 +9632,7 @@ static void normalize_asm_text(asm_statement_t *asm_statement)
 				entity_t *argument = get_entity(symbol, NAMESPACE_ASM_ARGUMENT);
 				if (argument == NULL) {
 					position_t errorpos = asm_statement->textpos;
-					errorpos.colno += c + 1 - asm_statement->asm_text->begin;
+					errorpos.offset += c + 1 - asm_statement->asm_text->begin;
 					errorf(&errorpos, "undefined assembler operand '%Y'", symbol);
 				} else {
 					obstack_printf(&string_obst, "%u", argument->asm_operand.pos);
@@ -9510,24 +9846,8 @@ static statement_t *parse_case_statement(void)
 	expect(':');
 
 	if (current_switch != NULL) {
-		if (!statement->case_label.is_bad) {
-			/* Check for duplicate case values */
-			case_label_statement_t *c = &statement->case_label;
-			for (case_label_statement_t *l = current_switch->first_case;
-			     l != NULL; l = l->next) {
-				if (l->is_bad || l->is_empty_range || l->expression == NULL)
-					continue;
-
-				if (tarval_cmp(c->last_case, l->first_case) == ir_relation_less
-				 || tarval_cmp(l->last_case, c->first_case) == ir_relation_less)
-					continue;
-
-				errorf(pos, "duplicate case value");
-				notef(&l->base.pos, "previous case label was here");
-				break;
-			}
-		}
-		/* link all cases into the switch statement */
+		/* link all cases into the switch statement, duplicates are reported
+		 * by check_case_labels() at the end of the switch */
 		if (current_switch->last_case == NULL) {
 			current_switch->first_case      = &statement->case_label;
 		} else {
@@ -9695,6 +10015,116 @@ static statement_t *parse_if(void)
 	return statement;
 }
 
+/**
+ * Reports a duplicate case value if the case label @p c overlaps one of the
+ * labels before it in @p statement.
+ */
+static void check_duplicate_case(switch_statement_t const *const statement,
+                                 case_label_statement_t const *const c)
+{
+	for (case_label_statement_t const *l = statement->first_case; l != c;
+	     l = l->next) {
+		if (l->is_bad || l->is_empty_range || l->expression == NULL)
+			continue;
+
+		if (tarval_cmp(c->last_case, l->first_case) == ir_relation_less
+		 || tarval_cmp(l->last_case, c->first_case) == ir_relation_less)
+			continue;
+
+		errorf(&c->base.pos, "duplicate case value");
+		notef(&l->base.pos, "previous case label was here");
+		break;
+	}
+}
+
+/** A case label together with its position in the switch. */
+typedef struct sorted_case_t {
+	case_label_statement_t *label;
+	size_t                  index; /**< position in the list of labels */
+} sorted_case_t;
+
+/** Orders case labels by their first value and then by their position. */
+static int compare_sorted_cases(const void *const a, const void *const b)
+{
+	sorted_case_t const *const case_a = (sorted_case_t const*)a;
+	sorted_case_t const *const case_b = (sorted_case_t const*)b;
+	ir_relation const relation
+		= tarval_cmp(case_a->label->first_case, case_b->label->first_case);
+	if (relation == ir_relation_less)
+		return -1;
+	if (relation == ir_relation_greater)
+		return 1;
+	return case_a->index < case_b->index ? -1 : case_a->index > case_b->index;
+}
+
+/**
+ * Sorts the case labels of a switch by value and reports duplicate case
+ * values. Sorting finds all labels overlapping another one, only these are
+ * compared with the labels before them, so a switch without duplicates costs
+ * O(n log n) instead of O(n²).
+ */
+static void check_case_labels(switch_statement_t *const statement)
+{
+	sorted_case_t *sorted   = NEW_ARR_F(sorted_case_t, 0);
+	size_t         n_labels = 0;
+	for (case_label_statement_t *l = statement->first_case; l != NULL;
+	     l = l->next, ++n_labels) {
+		if (l->expression == NULL || l->first_case == NULL || l->is_empty_range)
+			continue;
+		sorted_case_t const entry = { .label = l, .index = n_labels };
+		ARR_APP1(sorted_case_t, sorted, entry);
+	}
+
+	/* without a valid switch type the values may have different modes */
+	type_t *const type    = skip_typeref(statement->expression->base.type);
+	bool const    ordered = is_type_valid(type);
+	size_t const  n_cases = ARR_LEN(sorted);
+	if (ordered)
+		qsort(sorted, n_cases, sizeof(sorted[0]), compare_sorted_cases);
+
+	/* Mark the labels overlapping another label: a label overlaps one sorted
+	 * before it iff it begins before the end of the label reaching furthest
+	 * so far. Each label overlapping a later one overlaps its successor or
+	 * reaches furthest when the successor is visited, so it is marked, too. */
+	bool  *const overlaps = NEW_ARR_FZ(bool, n_labels);
+	size_t       furthest = (size_t)-1;
+	for (size_t i = 0; ordered && i != n_cases; ++i) {
+		case_label_statement_t const *const l = sorted[i].label;
+		if (l->is_bad)
+			continue;
+		if (furthest != (size_t)-1) {
+			case_label_statement_t const *const f = sorted[furthest].label;
+			if (tarval_cmp(l->first_case, f->last_case) != ir_relation_greater) {
+				overlaps[sorted[i].index]        = true;
+				overlaps[sorted[furthest].index] = true;
+			}
+			if (tarval_cmp(l->last_case, f->last_case) != ir_relation_greater)
+				continue;
+		}
+		furthest = i;
+	}
+
+	size_t index = 0;
+	for (case_label_statement_t const *c = statement->first_case; c != NULL;
+	     c = c->next, ++index) {
+		if (c->is_bad || c->expression == NULL)
+			continue;
+		/* empty ranges are not sorted, but may still lie within a range */
+		if (!ordered || overlaps[index] || c->is_empty_range)
+			check_duplicate_case(statement, c);
+	}
+	DEL_ARR_F(overlaps);
+
+	case_label_statement_t **const cases
+		= allocate_ast_zero(n_cases * sizeof(cases[0]));
+	for (size_t i = 0; i != n_cases; ++i) {
+		cases[i] = sorted[i].label;
+	}
+	statement->sorted_cases   = cases;
+	statement->n_sorted_cases = n_cases;
+	DEL_ARR_F(sorted);
+}
+
 /**
  * Check that all enums are handled in a switch.
  *
@@ -9775,6 +10205,7 @@ static statement_t *parse_switch(void)
 	statement->switchs.body = parse_inner_statement();
 	current_switch          = rem;
 
+	check_case_labels(&statement->switchs);
 	if (statement->switchs.default_label == NULL)
 		warningf(WARN_SWITCH_DEFAULT, &statement->base.pos,
 		         "switch has no default case");
@@ -10828,6 +11259,9 @@ static void check_unused_globals(void)
 {
 	if (!is_warn_on(WARN_UNUSED_FUNCTION) && !is_warn_on(WARN_UNUSED_VARIABLE))
 		return;
+	/* uses in skipped function bodies are unknown */
+	if (lazy_function_bodies)
+		return;
 
 	for (entity_t const *entity = file_scope->first_entity; entity != NULL;
 	     entity = entity->base.next) {
@@ -10926,9 +11360,11 @@ static void parse_external(void)
 	                               implicit int) */
 	case '*':  /* * x; -> int* x; */
 	case '(':  /* (x); -> int (x); */
+			trace_begin_at("Parse declaration", HERE);
 			PUSH_EXTENSION();
 			parse_external_declaration(0);
 			POP_EXTENSION();
+			trace_end();
 		}
 		return;
 
@@ -11151,6 +11587,7 @@ static void prepare_main_collect2(entity_t *const entity)
 void parse(void)
 {
 	lookahead_bufpos = 0;
+	n_pushed_tokens  = 0;
 	for (int i = 0; i < MAX_LOOKAHEAD + 2; ++i) {
 		next_token();
 	}
@@ -11171,6 +11608,7 @@ void init_parser(void)
 
 	string_true  = make_string("true");
 	string_false = make_string("false");
+	memset(byte_strings, 0, sizeof(byte_strings));
 }
 
 void exit_parser(void)
@@ -35,6 +35,13 @@ void parse(void);
  */
 translation_unit_t *finish_parsing(void);
 
+/**
+ * Skip the bodies of function definitions at file scope, they are replaced by
+ * empty compound statements. Only for users of the AST which look at
+ * declarations, the AST must not be printed or translated to firm then.
+ */
+extern bool lazy_function_bodies;
+
 /** set default elf visbility */
 void set_default_visibility(elf_visibility_t visibility);
 
@@ -10,14 +10,32 @@
 #include <errno.h>
 #include <libfirm/firm_common.h>
 #include <libfirm/irmode.h>
+#include <libfirm/timing.h>
 #include <libfirm/tv.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+/* Directory listings of the search path answer most failing header lookups
+ * without a system call. They are only used on systems whose file names are
+ * case sensitive by default, directories with case insensitive names (like
+ * casefolded ext4 directories) are detected when they are listed. */
+#if defined(HAVE_OPENDIR) && defined(HAVE_FSTAT) \
+ && (defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) \
+  || defined(__OpenBSD__) || defined(__DragonFly__))
+#define LIST_SEARCHPATH
+#include <dirent.h>
+#endif
 
 #include "adt/array.h"
+#include "adt/hash_string.h"
 #include "adt/panic.h"
-#include "adt/pset_new.h"
 #include "adt/separator_t.h"
 #include "adt/strutil.h"
 #include "adt/unicode.h"
@@ -33,7 +51,6 @@
 #include "input.h"
 
 #define MAX_PUTBACK   3
-#define BUFSIZE       1024
 #define INCLUDE_LIMIT 199  /* 199 is for gcc "compatibility" */
 
 typedef struct whitespace_info_t {
@@ -58,8 +75,12 @@ struct pp_definition_t {
 	/* replacement */
 	size_t           list_len;
 	token_t         *token_list;
+	/* parameters: the macro expanded argument, NULL until first needed */
+	token_t         *expanded_list;
 
 	position_t       pos;
+	/** 1 + index of the profile record of the macro, 0 if it has none */
+	unsigned         profile_index;
 	bool             is_expanding    : 1;
 	bool             may_recurse     : 1;
 	bool             has_parameters  : 1;
@@ -68,6 +89,7 @@ struct pp_definition_t {
 	bool             standard_define : 1;
 	bool             not_specified   : 1;
 	bool             is_pragma       : 1; /* _Pragma */
+	bool             expand_once     : 1; /* parameter expanded several times */
 };
 
 typedef struct pp_expansion_state_t {
@@ -79,6 +101,8 @@ typedef struct pp_expansion_state_t {
 	/** the obstack level at the beginning of a macro call with parameters.
 	 * We can free the obstack until this level after expanding the call */
 	void              *obstack_level;
+	/** the tokens of all arguments of a macro call with parameters */
+	token_t           *arguments;
 
 	whitespace_info_t  expand_info;
 	bool               previous_is_expanding;
@@ -90,6 +114,7 @@ typedef struct pp_expansion_state_t {
 typedef struct pp_argument_t {
 	size_t   list_len;
 	token_t *token_list;
+	token_t *expanded_list;
 	bool     is_expanding;
 } pp_argument_t;
 
@@ -103,30 +128,60 @@ struct pp_conditional_t {
 	bool              skip      : 1;
 };
 
+/**
+ * State of the multiple include optimization: A file whose whole content is
+ * enclosed in #ifndef GUARD ... #endif need not be read again while GUARD is
+ * defined.
+ */
+typedef enum mi_state_t {
+	MI_START,       /**< nothing but whitespace and comments read so far */
+	MI_IN_GUARD,    /**< inside the #ifndef which might be the guard */
+	MI_AFTER_GUARD, /**< after the #endif of the guard */
+	MI_INVALID,     /**< the file does not have an include guard */
+} mi_state_t;
+
 typedef struct pp_input_t pp_input_t;
 struct pp_input_t {
 	utf32               c;
-	utf32              *buf;
-	const utf32        *bufend;
-	const utf32        *bufpos;
+	/** next byte to read, the input is read in place as utf-8 */
+	const char         *cur;
+	/** end of the input, *end is '\0' */
+	const char         *end;
+	/** read position in the input while put back characters are pending */
+	const char         *saved_cur;
+	utf32               putback[MAX_PUTBACK];
+	unsigned            n_putback;
 	input_t            *input;
 	pp_input_t         *parent;
 	searchpath_entry_t *path;
 	char const         *real_name;
-	position_t          pos;
+	/** the beginning of the input and the position of its first byte */
+	const char         *begin;
+	position_t          start;
 	unsigned            output_line;
+	mi_state_t          mi_state;
+	/** the conditional and macro of the include guard candidate */
+	pp_conditional_t   *mi_conditional;
+	symbol_t           *mi_guard;
 };
 
 struct searchpath_entry_t {
 	const char         *path;
 	searchpath_entry_t *next;
+	/** sorted names in the directory, NULL if they are unknown */
+	char const        **names;
+	size_t              n_names;
 	bool                is_system_path;
+	bool                listed; /**< reading the names was attempted */
 };
 
 typedef struct macro_call_t {
 	pp_definition_t *macro;
 	pp_definition_t *parameter;
+	/** the tokens of all arguments collected so far, one after another */
 	token_t         *argument_tokens;
+	/** index of the first token of the current argument */
+	size_t           argument_begin;
 	void            *obstack_level;
 	unsigned         argument_brace_count;
 	unsigned         parameter_idx         : 30;
@@ -138,9 +193,23 @@ typedef struct include_t include_t;
 struct include_t {
 	include_t  *next;
 	const char *filename;
+	/** macro guarding the file against multiple inclusion, if detected */
+	symbol_t   *guard;
 	bool        is_system_header;
+	bool        once; /**< file contains #pragma once */
+	/** errno of the failed lookup of this path, 0 if the file exists */
+	int         error;
 };
 
+#undef HashSetIterator
+#define HashSet         include_set_t
+#define ValueType       include_t*
+#include "adt/hashset.h"
+#undef ValueType
+#undef HashSet
+
+typedef struct include_set_t include_set_t;
+
 static pp_input_t      input;
 
 static pp_input_t     *input_stack;
@@ -154,8 +223,11 @@ static pp_conditional_t *conditional_stack;
 token_t                      pp_token;
 input_decoder_t             *input_decoder = &input_decode_utf8;
 bool                         no_dollar_in_symbol;
+bool                         directives_only;
 static bool                  resolve_escape_sequences;
 static bool                  skip_mode;
+/** only directives are evaluated, other lines are skipped like in skip_mode */
+static bool                  scan_directives_only;
 static bool                  stop_at_newline;
 static FILE                 *out;
 static struct obstack        pp_obstack;
@@ -166,14 +238,33 @@ static macro_call_t          current_call;
 static whitespace_info_t     call_whitespace_info;
 static bool                  call_space_before;
 static pp_definition_t      *argument_expanding;
+/** expansions below this stack index are hidden while expanding an argument */
+static size_t                argument_expansion_base;
 static token_kind_t          previous_token;
 static pp_expansion_state_t *expansion_stack;
 static pp_argument_t        *argument_stack;
+/** argument token lists of finished macro calls, kept for reuse */
+static token_t             **free_argument_lists;
 static macro_call_t         *macro_call_stack;
 
-static pset_new_t            includeset;
+static include_set_t         includeset;
 static include_t            *includes;
 static include_t            *last_include;
+/** include records of the compilation unit, they survive the macro calls
+ * whose arguments contain the directives reading the files */
+static struct obstack        include_obstack;
+
+/** A file read by #embed, kept until the end of the compilation unit. */
+typedef struct pp_resource_t {
+	resource_t  resource;
+	const char *filename;
+	input_t    *input;
+} pp_resource_t;
+
+static pp_resource_t       **resources;
+/** tokens replacing the last #embed directive, NULL if there are none left */
+static token_t              *embed_tokens;
+static size_t                embed_pos;
 
 struct searchpath_t {
 	searchpath_entry_t  *first;
@@ -216,6 +307,439 @@ static void init_symbols(void)
 }
 
 static void print_line_directive(const position_t *pos, const char *add);
+static void next_expanded_token(void);
+
+/**
+ * Preprocessed output is collected here and written with few large write
+ * calls instead of going through stdio for every token.
+ */
+static char   out_buffer[256 * 1024];
+static size_t out_size;
+/** the last line marker, while it is still at the end of out_buffer */
+static size_t      marker_begin = (size_t)-1;
+static size_t      marker_end   = (size_t)-1;
+static const char *marker_flag;
+
+static void write_output(const char *data, size_t size)
+{
+#ifdef HAVE_FILENO
+	int const fd = fileno(out);
+	while (size > 0) {
+		ssize_t const written = write(fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			errorf(NULL, "writing preprocessed output failed: %s",
+			       strerror(errno));
+			return;
+		}
+		data += written;
+		size -= (size_t)written;
+	}
+#else
+	if (fwrite(data, 1, size, out) != size)
+		errorf(NULL, "writing preprocessed output failed: %s", strerror(errno));
+#endif
+}
+
+static void flush_output(void)
+{
+	if (out_size == 0)
+		return;
+	write_output(out_buffer, out_size);
+	out_size     = 0;
+	marker_begin = (size_t)-1;
+	marker_end   = (size_t)-1;
+}
+
+static inline void out_mem(const char *const data, size_t const size)
+{
+	if (size > sizeof(out_buffer) - out_size) {
+		flush_output();
+		if (size > sizeof(out_buffer)) {
+			write_output(data, size);
+			return;
+		}
+	}
+	memcpy(&out_buffer[out_size], data, size);
+	out_size += size;
+}
+
+static inline void out_char(char const c)
+{
+	if (out_size == sizeof(out_buffer))
+		flush_output();
+	out_buffer[out_size++] = c;
+}
+
+static void out_str(const char *const string)
+{
+	out_mem(string, strlen(string));
+}
+
+static void out_unsigned(unsigned value)
+{
+	char  buf[sizeof(value) * 3];
+	char *end = buf + sizeof(buf);
+	char *p   = end;
+	do {
+		*--p   = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	out_mem(p, end - p);
+}
+
+/*
+ * Preprocessor profile (-fpp-profile): the time spent in each input with and
+ * without the inputs it includes, its size and tokens, and the expansions of
+ * each macro.
+ */
+#define NO_PROFILE_FILE ((size_t)-1)
+#define PP_PROFILE_TOP  20
+
+typedef struct pp_profile_file_t {
+	const char   *name;
+	size_t        parent;       /**< the including input */
+	size_t        first_child;
+	size_t        last_child;
+	size_t        next_sibling;
+	unsigned long self_usec;
+	unsigned long total_usec;   /**< computed when printing */
+	unsigned long bytes;
+	unsigned long tokens;
+	unsigned long skipped_bytes; /**< in conditional blocks not compiled */
+	unsigned      n_entered;     /**< for the summary */
+} pp_profile_file_t;
+
+typedef struct pp_profile_macro_t {
+	pp_definition_t *definition;
+	unsigned long    expansions;
+	/** tokens produced by the expansions started from the input */
+	unsigned long    tokens;
+} pp_profile_macro_t;
+
+static bool                profiling;
+static ir_timer_t         *profile_timer;
+static unsigned long       profile_last_usec;
+static pp_profile_file_t  *profile_files;
+static pp_profile_macro_t *profile_macros;
+static size_t              profile_current = NO_PROFILE_FILE;
+/** 1 + index of the macro expanded from the input, 0 if none */
+static unsigned            profile_macro;
+
+static void profile_charge_time(void)
+{
+	ir_timer_stop(profile_timer);
+	unsigned long const now = ir_timer_elapsed_usec(profile_timer);
+	ir_timer_start(profile_timer);
+	if (profile_current != NO_PROFILE_FILE)
+		profile_files[profile_current].self_usec += now - profile_last_usec;
+	profile_last_usec = now;
+}
+
+static void profile_enter_input(const char *const name, size_t const bytes)
+{
+	profile_charge_time();
+	size_t            const index = ARR_LEN(profile_files);
+	pp_profile_file_t const file  = {
+		.name         = name,
+		.parent       = profile_current,
+		.first_child  = NO_PROFILE_FILE,
+		.last_child   = NO_PROFILE_FILE,
+		.next_sibling = NO_PROFILE_FILE,
+		.bytes        = bytes,
+		.n_entered    = 1,
+	};
+	ARR_APP1(pp_profile_file_t, profile_files, file);
+	if (profile_current != NO_PROFILE_FILE) {
+		pp_profile_file_t *const parent = &profile_files[profile_current];
+		if (parent->first_child == NO_PROFILE_FILE) {
+			parent->first_child = index;
+		} else {
+			profile_files[parent->last_child].next_sibling = index;
+		}
+		parent->last_child = index;
+	}
+	profile_current = index;
+}
+
+static void profile_leave_input(void)
+{
+	profile_charge_time();
+	profile_current = profile_files[profile_current].parent;
+}
+
+static void profile_expansion(pp_definition_t *const definition)
+{
+	if (definition->profile_index == 0) {
+		pp_profile_macro_t const macro = { .definition = definition };
+		ARR_APP1(pp_profile_macro_t, profile_macros, macro);
+		definition->profile_index = ARR_LEN(profile_macros);
+	}
+	++profile_macros[definition->profile_index - 1].expansions;
+	if (current_expansion == NULL)
+		profile_macro = definition->profile_index;
+}
+
+static void profile_token(void)
+{
+	if (current_expansion != NULL && profile_macro != 0) {
+		++profile_macros[profile_macro - 1].tokens;
+	} else if (profile_current != NO_PROFILE_FILE) {
+		++profile_files[profile_current].tokens;
+	}
+}
+
+void start_pp_profile(void)
+{
+	if (profile_files == NULL) {
+		profile_files  = NEW_ARR_F(pp_profile_file_t, 0);
+		profile_macros = NEW_ARR_F(pp_profile_macro_t, 0);
+		profile_timer  = ir_timer_new();
+	}
+	ARR_SHRINKLEN(profile_files, 0);
+	ARR_SHRINKLEN(profile_macros, 0);
+	profile_current   = NO_PROFILE_FILE;
+	profile_macro     = 0;
+	profile_last_usec = 0;
+	ir_timer_reset_and_start(profile_timer);
+	profiling = true;
+}
+
+static void print_profile_file(FILE *const f, size_t const index)
+{
+	pp_profile_file_t const *const file = &profile_files[index];
+	fputs("{\"name\":", f);
+	print_json_string(f, file->name);
+	fprintf(f, ",\"total_us\":%lu,\"self_us\":%lu,\"bytes\":%lu,\"tokens\":%lu,\"skipped_bytes\":%lu,\"includes\":[",
+	        file->total_usec, file->self_usec, file->bytes, file->tokens,
+	        file->skipped_bytes);
+	separator_t sep = { "", "," };
+	for (size_t child = file->first_child; child != NO_PROFILE_FILE;
+	     child = profile_files[child].next_sibling) {
+		fputs(sep_next(&sep), f);
+		print_profile_file(f, child);
+	}
+	fputs("]}", f);
+}
+
+static int compare_profile_names(const void *const a, const void *const b)
+{
+	pp_profile_file_t const *const file_a = (pp_profile_file_t const*)a;
+	pp_profile_file_t const *const file_b = (pp_profile_file_t const*)b;
+	return strcmp(file_a->name, file_b->name);
+}
+
+static int compare_profile_totals(const void *const a, const void *const b)
+{
+	unsigned long const total_a = ((pp_profile_file_t const*)a)->total_usec;
+	unsigned long const total_b = ((pp_profile_file_t const*)b)->total_usec;
+	return total_a < total_b ? 1 : total_a > total_b ? -1 : 0;
+}
+
+static int compare_profile_macros(const void *const a, const void *const b)
+{
+	pp_profile_macro_t const *const macro_a = (pp_profile_macro_t const*)a;
+	pp_profile_macro_t const *const macro_b = (pp_profile_macro_t const*)b;
+	if (macro_a->tokens != macro_b->tokens)
+		return macro_a->tokens < macro_b->tokens ? 1 : -1;
+	if (macro_a->expansions != macro_b->expansions)
+		return macro_a->expansions < macro_b->expansions ? 1 : -1;
+	return 0;
+}
+
+void print_pp_profile(FILE *const f)
+{
+	assert(profiling);
+	profiling = false;
+	ir_timer_stop(profile_timer);
+
+	/* includes come after the including input */
+	size_t const n_files = ARR_LEN(profile_files);
+	for (size_t i = n_files; i-- > 0;) {
+		pp_profile_file_t *const file = &profile_files[i];
+		file->total_usec += file->self_usec;
+		if (file->parent != NO_PROFILE_FILE)
+			profile_files[file->parent].total_usec += file->total_usec;
+	}
+
+	fputs("{\"inputs\":", f);
+	if (n_files > 0)
+		print_profile_file(f, 0);
+
+	/* summary of the files, summed up over all inclusions */
+	fputs(",\"top_files\":[", f);
+	qsort(profile_files, n_files, sizeof(profile_files[0]),
+	      compare_profile_names);
+	size_t n_summary = 0;
+	for (size_t i = 0; i != n_files; ++i) {
+		pp_profile_file_t const *const file = &profile_files[i];
+		if (n_summary > 0 && streq(profile_files[n_summary - 1].name, file->name)) {
+			pp_profile_file_t *const summary = &profile_files[n_summary - 1];
+			summary->total_usec    += file->total_usec;
+			summary->self_usec     += file->self_usec;
+			summary->tokens        += file->tokens;
+			summary->skipped_bytes += file->skipped_bytes;
+			summary->n_entered     += file->n_entered;
+		} else {
+			profile_files[n_summary++] = *file;
+		}
+	}
+	qsort(profile_files, n_summary, sizeof(profile_files[0]),
+	      compare_profile_totals);
+	separator_t sep = { "", "," };
+	for (size_t i = 0; i != n_summary && i != PP_PROFILE_TOP; ++i) {
+		pp_profile_file_t const *const file = &profile_files[i];
+		fputs(sep_next(&sep), f);
+		fputs("{\"name\":", f);
+		print_json_string(f, file->name);
+		fprintf(f, ",\"entered\":%u,\"total_us\":%lu,\"self_us\":%lu,\"tokens\":%lu,\"skipped_bytes\":%lu}",
+		        file->n_entered, file->total_usec, file->self_usec,
+		        file->tokens, file->skipped_bytes);
+	}
+
+	fputs("],\"top_macros\":[", f);
+	size_t const n_macros = ARR_LEN(profile_macros);
+	qsort(profile_macros, n_macros, sizeof(profile_macros[0]),
+	      compare_profile_macros);
+	sep = (separator_t){ "", "," };
+	for (size_t i = 0; i != n_macros && i != PP_PROFILE_TOP; ++i) {
+		pp_profile_macro_t const *const macro = &profile_macros[i];
+		position_info_t const info = get_position_info(&macro->definition->pos);
+		fputs(sep_next(&sep), f);
+		fputs("{\"name\":", f);
+		print_json_string(f, macro->definition->symbol->string);
+		fputs(",\"defined_at\":", f);
+		print_json_string(f, info.input_name);
+		fprintf(f, ",\"line\":%u,\"expansions\":%lu,\"tokens\":%lu}",
+		        info.lineno, macro->expansions, macro->tokens);
+	}
+	fputs("]}\n", f);
+
+	/* the records now refer to freed or reordered data */
+	for (size_t i = 0; i != n_macros; ++i) {
+		profile_macros[i].definition->profile_index = 0;
+	}
+	ARR_SHRINKLEN(profile_files, 0);
+	ARR_SHRINKLEN(profile_macros, 0);
+}
+
+#define HashSet                    include_set_t
+#define ValueType                  include_t*
+#define NullValue                  NULL
+#define DeletedValue               ((include_t*)-1)
+#define Hash(this, key)            hash_string((key)->filename)
+#define KeysEqual(this,key1,key2)  streq((key1)->filename, (key2)->filename)
+#define SetRangeEmpty(ptr,size)    memset(ptr, 0, (size) * sizeof(*(ptr)))
+
+void include_set_init_(include_set_t *set);
+#define hashset_init             include_set_init_
+void include_set_destroy_(include_set_t *set);
+#define hashset_destroy          include_set_destroy_
+include_t *include_set_insert(include_set_t *set, include_t *include);
+#define hashset_insert           include_set_insert
+include_t *include_set_find(const include_set_t *set, const include_t *include);
+#define hashset_find             include_set_find
+#define SCALAR_RETURN
+
+#include "adt/hashset.c.h"
+
+/**
+ * Returns the include record for file @p name or NULL if it was neither read
+ * nor looked up unsuccessfully.
+ */
+static include_t *find_include(char const *const name)
+{
+	include_t const key = { .filename = name };
+	return include_set_find(&includeset, &key);
+}
+
+/**
+ * Remembers that there is no file @p name, so later lookups of the same
+ * header in the same directory fail without a system call. Only errno values
+ * saying that the file does not exist are remembered, other errors (like
+ * running out of file descriptors) may go away, so the lookup is retried.
+ */
+static void remember_missing(char const *const name)
+{
+	if (errno != ENOENT && errno != ENOTDIR)
+		return;
+	include_t *const include = OALLOCZ(&include_obstack, include_t);
+	include->filename = obstack_copy(&include_obstack, name, strlen(name) + 1);
+	include->error    = errno;
+	include_set_insert(&includeset, include);
+}
+
+/** Tracks file @p name for dependency output, unless it was read before. */
+static void record_include(char const *const name, bool const is_system_header)
+{
+	if (find_include(name) != NULL)
+		return;
+
+	include_t *include = OALLOCZ(&include_obstack, include_t);
+	include->filename         = name;
+	include->is_system_header = is_system_header;
+	include_set_insert(&includeset, include);
+	if (last_include != NULL) {
+		last_include->next = include;
+	} else {
+		includes = include;
+	}
+	last_include = include;
+}
+
+#if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
+/**
+ * Identifies a file independent of the path used to reach it, for
+ * #pragma once.
+ */
+typedef struct file_id_t {
+	dev_t dev;
+	ino_t ino;
+} file_id_t;
+
+/** identities of all files containing #pragma once, sorted by device and
+ * inode */
+static file_id_t *once_files;
+
+/** Returns the index of the first entry of once_files not before @p id. */
+static size_t find_once_file(file_id_t const id)
+{
+	size_t lo = 0;
+	size_t hi = ARR_LEN(once_files);
+	while (lo < hi) {
+		size_t    const mid   = lo + (hi - lo) / 2;
+		file_id_t const entry = once_files[mid];
+		if (entry.dev < id.dev || (entry.dev == id.dev && entry.ino < id.ino)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static bool is_once_file(struct stat const *const st)
+{
+	file_id_t const id = { st->st_dev, st->st_ino };
+	size_t    const i  = find_once_file(id);
+	return i != ARR_LEN(once_files)
+	    && once_files[i].dev == id.dev && once_files[i].ino == id.ino;
+}
+
+/** Adds the file with the status @p st to once_files. */
+static void add_once_file(struct stat const *const st)
+{
+	file_id_t const id = { st->st_dev, st->st_ino };
+	size_t    const i  = find_once_file(id);
+	size_t    const n  = ARR_LEN(once_files);
+	if (i != n && once_files[i].dev == id.dev && once_files[i].ino == id.ino)
+		return;
+	ARR_APP1(file_id_t, once_files, id);
+	memmove(&once_files[i + 1], &once_files[i], (n - i) * sizeof(*once_files));
+	once_files[i] = id;
+}
+#endif
 
 /**
  * Switch input to another file/stream. Assume input_name is identified in the
@@ -225,22 +749,21 @@ static void switch_input(input_t *const decoder, char const *const input_name,
                          searchpath_entry_t *const path,
                          bool const is_system_header)
 {
-	utf32 *const buf = XMALLOCN(utf32, BUFSIZE + MAX_PUTBACK);
-	utf32 *const end = buf + MAX_PUTBACK;
+	char const *begin;
+	char const *end;
+	input_get_utf8(decoder, &begin, &end);
 	input = (pp_input_t){
 		.input              = decoder,
-		.buf                = buf,
-		.bufend             = end,
-		.bufpos             = end,
+		.cur                = begin,
+		.end                = end,
 		.output_line        = 0,
 		.real_name          = input_name,
-		.pos = {
-			.input_name       = input_name,
-			.lineno           = 1,
-			.is_system_header = is_system_header,
-		},
+		.begin              = begin,
+		.start              = add_input_text(input_name, begin, end - begin, is_system_header),
 		.path               = path,
 	};
+	if (profiling && input_name != builtin_input_name)
+		profile_enter_input(input_name, end - begin);
 
 	/* indicate that we're at a new input */
 	const char *line_flag;
@@ -252,29 +775,13 @@ static void switch_input(input_t *const decoder, char const *const input_name,
 	} else {
 		line_flag = "1";
 	}
-	print_line_directive(&input.pos, line_flag);
-
-	/* place a virtual '\n' so we realize we're at line begin
-	 * (remember this special case in input_error) */
-	input.pos.lineno = 0;
-	input.c          = '\n';
-
-	/* track include (for dependency output) */
-	if (input_name != builtin_position.input_name) {
-		bool new_dep = pset_new_insert(&includeset, (void*)input_name);
-		if (new_dep) {
-			include_t *include = OALLOC(&pp_obstack, include_t);
-			include->next             = NULL;
-			include->filename         = input_name;
-			include->is_system_header = is_system_header;
-			if (last_include != NULL) {
-				last_include->next = include;
-			} else {
-				includes = include;
-			}
-			last_include = include;
-		}
-	}
+	print_line_directive(&input.start, line_flag);
+
+	/* place a virtual '\n' so we realize we're at line begin */
+	input.c = '\n';
+
+	if (input_name != builtin_input_name)
+		record_include(input_name, is_system_header);
 }
 
 void switch_pp_input(FILE *const stream, char const *const input_name, searchpath_entry_t *const path, bool const is_system_header)
@@ -284,19 +791,63 @@ void switch_pp_input(FILE *const stream, char const *const input_name, searchpat
 	switch_input(input, string->begin, path, is_system_header);
 }
 
-static bool try_switch_input(char const* const name, searchpath_entry_t *const path, bool const is_system_header)
+typedef enum include_result_t {
+	INCLUDE_NOT_FOUND,
+	INCLUDE_ENTERED,
+	INCLUDE_SKIPPED, /**< the file has no effect when included again */
+} include_result_t;
+
+static include_result_t try_switch_input(char const* const name, searchpath_entry_t *const path, bool const is_system_header)
 {
+	include_t const *const include = find_include(name);
+	if (include != NULL) {
+		if (include->error != 0) {
+			errno = include->error;
+			return INCLUDE_NOT_FOUND;
+		}
+		if (include->once)
+			return INCLUDE_SKIPPED;
+		if (include->guard != NULL && include->guard->pp_definition != NULL)
+			return INCLUDE_SKIPPED;
+	}
+#if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
+	else if (ARR_LEN(once_files) != 0) {
+		/* the file might have been read through a different path */
+		struct stat st;
+		if (stat(name, &st) != 0) {
+			remember_missing(name);
+			return INCLUDE_NOT_FOUND;
+		}
+		if (is_once_file(&st))
+			return INCLUDE_SKIPPED;
+	}
+#endif
+
 	FILE *const file = fopen(name, "r");
-	if (!file)
-		return false;
+	if (!file) {
+		remember_missing(name);
+		return INCLUDE_NOT_FOUND;
+	}
 	switch_pp_input(file, name, path, is_system_header);
-	return true;
+	return INCLUDE_ENTERED;
+}
+
+static void free_input_text(void *const data)
+{
+	input_free((input_t*)data);
 }
 
 void close_pp_input(void)
 {
-	free(input.buf);
-	input_free(input.input);
+	if (profiling && input.real_name != builtin_input_name)
+		profile_leave_input();
+	/* the text of string inputs belongs to the caller */
+	if (input_get_file(input.input) != NULL) {
+		release_input_text(input.start, free_input_text, input.input);
+	} else {
+		release_input_text(input.start, NULL, NULL);
+		input_free(input.input);
+	}
 }
 
 static void close_pp_input_file(void)
@@ -310,13 +861,15 @@ static void close_pp_input_file(void)
 void print_pp_header(void)
 {
 	/* this is just here to make our output look similar to the gcc one */
-	position_t first_pos = input.pos;
-	first_pos.lineno = 1;
-	print_line_directive(&first_pos, NULL);
-	fputc('\n', out);
-	fprintf(out, "# 1 \"<built-in>\"\n");
-	fprintf(out, "# 1 \"<command-line>\"\n");
-	print_line_directive(&first_pos, NULL);
+	print_line_directive(&input.start, NULL);
+	out_str("\n# 1 \"<built-in>\"\n# 1 \"<command-line>\"\n");
+	print_line_directive(&input.start, NULL);
+}
+
+void finish_pp_output(void)
+{
+	out_char('\n');
+	flush_output();
 }
 
 static void push_input(void)
@@ -353,24 +906,87 @@ static void parse_error(const char *msg)
 	errorf(&pp_token.base.pos, "%s", msg);
 }
 
+/**
+ * input.cur points here while put back characters are pending. This makes
+ * next_real_char() take its slow path without an additional check.
+ */
+static char const putback_marker[1];
+
+/**
+ * Returns the position of the byte at @p cur in the current input. The
+ * command line has no text, positions in it refer to it as a whole.
+ */
+static position_t byte_position(char const *const cur)
+{
+	if (input.begin == NULL)
+		return input.start;
+	return (position_t){ input.start.offset + (uint32_t)(cur - input.begin) };
+}
+
+/**
+ * Returns the position of the current character input.c. The result is valid
+ * until the next call.
+ */
+static position_t const *input_position(void)
+{
+	static position_t pos;
+	char const *cur = input.cur;
+	size_t      n_back; /* bytes of input.c before cur */
+	if (cur == putback_marker) {
+		cur    = input.saved_cur;
+		n_back = input.n_putback + 1;
+	} else if (input.c == UTF32_EOF) {
+		n_back = 0;
+	} else {
+		utf32 const c = input.c;
+		n_back = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+	}
+	if (input.begin == NULL) {
+		pos = input.start;
+	} else if ((size_t)(cur - input.begin) < n_back) {
+		/* the position before the first byte refers to the whole input */
+		pos.offset = input.start.offset - 1;
+	} else {
+		pos = byte_position(cur - n_back);
+	}
+	return &pos;
+}
+
+/**
+ * Slow path of next_real_char(): Handles put back characters, non-ASCII
+ * characters, '\0' characters and the end of the input.
+ */
+static void next_real_char_slow(void)
+{
+	char const *const cur = input.cur;
+	if (cur == putback_marker) {
+		input.c = input.putback[--input.n_putback];
+		if (input.n_putback == 0)
+			input.cur = input.saved_cur;
+	} else if (*cur != '\0') {
+		input.c = input_read_utf8_char(&input.cur);
+	} else if (cur != input.end) {
+		++input.cur;
+		input.c = '\0';
+	} else {
+		input.c = UTF32_EOF;
+	}
+}
+
 /**
  * Sets input.c to the next character in the input or EOF if there are no
  * further characters.
  */
 static inline void next_real_char(void)
 {
-	assert(input.bufpos <= input.bufend);
-	if (input.bufpos >= input.bufend) {
-		size_t const n = decode(input.input, input.buf + MAX_PUTBACK, BUFSIZE);
-		if (n == 0) {
-			input.c = UTF32_EOF;
-			return;
-		}
-		input.bufpos = input.buf + MAX_PUTBACK;
-		input.bufend = input.bufpos + n;
+	unsigned char const c = *input.cur;
+	/* fast path for ASCII characters except '\0' */
+	if (LIKELY(c - 1U < 0x7FU)) {
+		++input.cur;
+		input.c = c;
+	} else {
+		next_real_char_slow();
 	}
-	input.c = *input.bufpos++;
-	++input.pos.colno;
 }
 
 /**
@@ -381,9 +997,12 @@ static inline void next_real_char(void)
  */
 static inline void put_back(utf32 const c)
 {
-	assert(input.bufpos > input.buf);
-	*(--input.bufpos - input.buf + input.buf) = input.c;
-	--input.pos.colno;
+	if (input.n_putback == 0) {
+		input.saved_cur = input.cur;
+		input.cur       = putback_marker;
+	}
+	assert(input.n_putback < MAX_PUTBACK);
+	input.putback[input.n_putback++] = input.c;
 	input.c = c;
 }
 
@@ -400,8 +1019,6 @@ static inline void put_back(utf32 const c)
 	case '\n': \
 			eat('\n'); \
 		} \
-		++input.pos.lineno; \
-		input.pos.colno = 1; \
 		goto newline; \
 		newline // Let it look like an ordinary case label.
 
@@ -415,7 +1032,7 @@ static void maybe_concat_lines(void)
 		return;
 
 	case UTF32_EOF:
-		warningf(WARN_OTHER, &input.pos, "'\\' at end of file");
+		warningf(WARN_OTHER, input_position(), "'\\' at end of file");
 		return;
 
 	default:
@@ -466,6 +1083,185 @@ static inline void next_char(void)
 	}
 }
 
+/** Classes of input bytes which need no phase 1 and 2 processing. */
+enum char_class_t {
+	CC_IDENT         = 1U << 0, /**< may continue an identifier */
+	CC_NUMBER        = 1U << 1, /**< may continue a pp-number, except 'e' and 'p' */
+	CC_WHITESPACE    = 1U << 2, /**< whitespace except newlines */
+	CC_LINE_COMMENT  = 1U << 3, /**< no special meaning in a line comment */
+	CC_BLOCK_COMMENT = 1U << 4, /**< no special meaning in a block comment */
+	CC_SKIPPED       = 1U << 5, /**< no special meaning in a skipped line */
+};
+
+static unsigned char char_classes[256];
+
+static void init_char_classes(void)
+{
+	for (unsigned c = 0; c < ARRAY_SIZE(char_classes); ++c) {
+		unsigned char cls = 0;
+		if (is_alpha(c) || is_digit(c) || c == '_') {
+			cls |= CC_IDENT;
+			if (c != 'e' && c != 'E' && c != 'p' && c != 'P')
+				cls |= CC_NUMBER;
+		} else if (c == '.') {
+			cls |= CC_NUMBER;
+		} else if (c == ' ' || c == '\t' || c == '\f' || c == '\v') {
+			cls |= CC_WHITESPACE;
+		}
+		if (c != '\0' && c < 0x80 && c != '\n' && c != '\r' && c != '\\'
+		 && c != '?') {
+			cls |= CC_LINE_COMMENT;
+			if (c != '*' && c != '/')
+				cls |= CC_BLOCK_COMMENT;
+			if (c != '/' && c != '"' && c != '\'')
+				cls |= CC_SKIPPED;
+		}
+		char_classes[c] = cls;
+	}
+}
+
+#if defined(__AVX2__)
+typedef __m256i vec_t;
+#define VEC_SIZE        32
+#define VEC_MASK_ALL    0xFFFFFFFFU
+#define vec_load(p)     _mm256_load_si256((vec_t const*)(p))
+#define vec_set1(c)     _mm256_set1_epi8(c)
+#define vec_eq(a, b)    _mm256_cmpeq_epi8((a), (b))
+#define vec_gt(a, b)    _mm256_cmpgt_epi8((a), (b))
+#define vec_and(a, b)   _mm256_and_si256((a), (b))
+#define vec_or(a, b)    _mm256_or_si256((a), (b))
+#define vec_mask(a)     ((unsigned)_mm256_movemask_epi8(a))
+#elif defined(__SSE2__)
+typedef __m128i vec_t;
+#define VEC_SIZE        16
+#define VEC_MASK_ALL    0xFFFFU
+#define vec_load(p)     _mm_load_si128((vec_t const*)(p))
+#define vec_set1(c)     _mm_set1_epi8(c)
+#define vec_eq(a, b)    _mm_cmpeq_epi8((a), (b))
+#define vec_gt(a, b)    _mm_cmpgt_epi8((a), (b))
+#define vec_and(a, b)   _mm_and_si128((a), (b))
+#define vec_or(a, b)    _mm_or_si128((a), (b))
+#define vec_mask(a)     ((unsigned)_mm_movemask_epi8(a))
+#endif
+
+#ifdef VEC_SIZE
+/**
+ * Tests bytes for lo <= x <= hi. The comparison is signed, so bytes >= 0x80
+ * are never in the (ASCII) range.
+ */
+static inline vec_t vec_in_range(vec_t const x, char const lo, char const hi)
+{
+	return vec_and(vec_gt(x, vec_set1(lo - 1)), vec_gt(vec_set1(hi + 1), x));
+}
+
+/**
+ * Returns a mask with a bit set for each byte of @p x which is not in the
+ * class @p cls. This matches the char_classes table.
+ */
+static inline unsigned vec_run_end_mask(vec_t const x, unsigned char const cls)
+{
+	switch (cls) {
+	case CC_IDENT:
+	case CC_NUMBER: {
+		vec_t const lower = vec_or(x, vec_set1(0x20));
+		vec_t       in    = vec_or(vec_in_range(lower, 'a', 'z'),
+		                           vec_in_range(x, '0', '9'));
+		in = vec_or(in, vec_eq(x, vec_set1('_')));
+		if (cls == CC_IDENT)
+			return vec_mask(in) ^ VEC_MASK_ALL;
+		unsigned const exponent = vec_mask(vec_or(vec_eq(lower, vec_set1('e')),
+		                                          vec_eq(lower, vec_set1('p'))));
+		unsigned const dot      = vec_mask(vec_eq(x, vec_set1('.')));
+		return ((vec_mask(in) & ~exponent) | dot) ^ VEC_MASK_ALL;
+	}
+	case CC_WHITESPACE: {
+		vec_t const in = vec_or(vec_or(vec_eq(x, vec_set1(' ')),
+		                               vec_eq(x, vec_set1('\t'))),
+		                        vec_or(vec_eq(x, vec_set1('\f')),
+		                               vec_eq(x, vec_set1('\v'))));
+		return vec_mask(in) ^ VEC_MASK_ALL;
+	}
+	case CC_LINE_COMMENT:
+	case CC_BLOCK_COMMENT:
+	case CC_SKIPPED: {
+		vec_t end = vec_or(vec_or(vec_eq(x, vec_set1('\n')),
+		                          vec_eq(x, vec_set1('\r'))),
+		                   vec_or(vec_eq(x, vec_set1('\\')),
+		                          vec_eq(x, vec_set1('?'))));
+		end = vec_or(end, vec_eq(x, vec_set1('\0')));
+		if (cls == CC_BLOCK_COMMENT) {
+			end = vec_or(end, vec_or(vec_eq(x, vec_set1('*')),
+			                         vec_eq(x, vec_set1('/'))));
+		} else if (cls == CC_SKIPPED) {
+			end = vec_or(end, vec_or(vec_eq(x, vec_set1('/')),
+			                         vec_or(vec_eq(x, vec_set1('"')),
+			                                vec_eq(x, vec_set1('\'')))));
+		}
+		/* the sign bits mark non-ASCII bytes */
+		return vec_mask(end) | vec_mask(x);
+	}
+	}
+	panic("invalid character class");
+}
+#endif
+
+/**
+ * Returns the end of the run of bytes of class @p cls starting at @p p in the
+ * current input. Runs never contain '\0', so the end of the input terminates
+ * every run.
+ */
+static inline char const *find_run_end(char const *p, unsigned char const cls)
+{
+#ifdef VEC_SIZE
+	/* Only aligned vectors lying completely within the input including its
+	 * terminating '\0' are loaded, the scalar loop handles the bytes at the
+	 * beginning and end of the input. */
+	char const *const limit    = input.end + 1;
+	unsigned    const misalign = (uintptr_t)p % VEC_SIZE;
+	char const       *block    = p - misalign;
+	if (block >= input.begin && block + VEC_SIZE <= limit) {
+		unsigned const mask
+			= vec_run_end_mask(vec_load(block), cls) >> misalign;
+		if (mask != 0)
+			return p + __builtin_ctz(mask);
+		block += VEC_SIZE;
+	} else {
+		block += VEC_SIZE;
+		for (; p != block; ++p) {
+			if (!(char_classes[(unsigned char)*p] & cls))
+				return p;
+		}
+	}
+	for (; block + VEC_SIZE <= limit; block += VEC_SIZE) {
+		unsigned const mask = vec_run_end_mask(vec_load(block), cls);
+		if (mask != 0)
+			return block + __builtin_ctz(mask);
+	}
+	p = block;
+#endif
+	while (char_classes[(unsigned char)*p] & cls)
+		++p;
+	return p;
+}
+
+/**
+ * Moves the input over the run of bytes of class @p cls following the
+ * current character and then sets input.c to the next character. The classes
+ * contain no trigraph or line splice characters and no non-ASCII bytes, so
+ * the run is skipped without looking at each character separately.
+ *
+ * @return the number of bytes in the run
+ */
+static inline size_t skip_run(unsigned char const cls)
+{
+	char const *const begin = input.cur;
+	char const *const end   = find_run_end(begin, cls);
+	size_t      const len   = end - begin;
+	input.cur = end;
+	next_char();
+	return len;
+}
+
 /**
  * Returns true if the given char is a octal digit.
  *
@@ -571,14 +1367,14 @@ static utf32 parse_universal_char(unsigned const n_digits)
 				obstack_1grow(&symbol_obstack, input.c);
 			next_char();
 		} else {
-			errorf(&input.pos,
+			errorf(input_position(),
 			       "short universal character name, expected %u more digits",
 				   k);
 			break;
 		}
 	}
 	if (!is_universal_char_valid(v)) {
-		errorf(&input.pos,
+		errorf(input_position(),
 		       "\\%c%0*X is not a valid universal character name",
 		       n_digits == 4 ? 'u' : 'U', (int)n_digits, v);
 	}
@@ -784,7 +1580,7 @@ static utf32 parse_escape_sequence(void)
 	}
 	put_back(ec);
 	/* §6.4.4.4:8 footnote 64 */
-	warningf(WARN_OTHER, &input.pos, "unknown escape sequence '\\%lc'", ec);
+	warningf(WARN_OTHER, input_position(), "unknown escape sequence '\\%lc'", ec);
 	return UTF32_EOF;
 }
 
@@ -815,7 +1611,7 @@ static void parse_string(utf32 const delimiter, token_kind_t const kind,
 				utf32 const tc = parse_escape_sequence();
 				if (tc != UTF32_EOF) {
 					if (tc > limit)
-						warningf(WARN_OTHER, &input.pos, "escape sequence out of range");
+						warningf(WARN_OTHER, input_position(), "escape sequence out of range");
 					if (enc == STRING_ENCODING_CHAR) {
 						obstack_1grow(&string_obst, tc);
 					} else {
@@ -949,6 +1745,23 @@ static void parse_character_constant(string_encoding_t const enc)
 	case '\t': \
 	case '\v'
 
+/** Returns an empty list for the argument tokens of a macro call. */
+static token_t *new_argument_list(void)
+{
+	size_t const n_free = ARR_LEN(free_argument_lists);
+	if (n_free == 0)
+		return NEW_ARR_F(token_t, 0);
+	token_t *const list = free_argument_lists[n_free - 1];
+	ARR_SHRINKLEN(free_argument_lists, n_free - 1);
+	return list;
+}
+
+static void free_argument_list(token_t *const list)
+{
+	ARR_SHRINKLEN(list, 0);
+	ARR_APP1(token_t*, free_argument_lists, list);
+}
+
 static pp_expansion_state_t *push_expansion(pp_definition_t *definition)
 {
 	ARR_EXTEND(pp_expansion_state_t, expansion_stack, 1);
@@ -975,6 +1788,7 @@ static void push_function_expansion(pp_definition_t *function)
 		pp_argument_t    arg = {
 			parameter->list_len,
 			parameter->token_list,
+			parameter->expanded_list,
 			parameter->is_expanding
 		};
 		ARR_APP1(pp_argument_t, argument_stack, arg);
@@ -989,9 +1803,12 @@ static void pop_function_expansion(pp_definition_t *function)
 	for (size_t i = n_parameters; i-- > 0; ) {
 		pp_definition_t     *parameter = &function->parameters[i];
 		const pp_argument_t *arg       = &argument_stack[--argument_stack_top];
-		parameter->list_len     = arg->list_len;
-		parameter->token_list   = arg->token_list;
-		parameter->is_expanding = arg->is_expanding;
+		if (parameter->expanded_list != NULL)
+			free_argument_list(parameter->expanded_list);
+		parameter->list_len      = arg->list_len;
+		parameter->token_list    = arg->token_list;
+		parameter->expanded_list = arg->expanded_list;
+		parameter->is_expanding  = arg->is_expanding;
 	}
 	ARR_SHRINKLEN(argument_stack, argument_stack_top);
 }
@@ -1003,6 +1820,7 @@ static bool pop_expansion(void)
 	pp_definition_t      *definition = expansion->definition;
 	if (definition->n_parameters > 0) {
 		obstack_free(&pp_obstack, expansion->obstack_level);
+		free_argument_list(expansion->arguments);
 		pop_function_expansion(definition);
 	}
 	definition->is_expanding = expansion->previous_is_expanding;
@@ -1033,8 +1851,6 @@ static bool pop_expansion(void)
 
 static void push_macro_call(void)
 {
-	if (current_call.macro == NULL)
-		return;
 	ARR_APP1(macro_call_t, macro_call_stack, current_call);
 	memset(&current_call, 0, sizeof(current_call));
 }
@@ -1052,21 +1868,22 @@ static void pop_macro_call(void)
 
 static void start_argument(pp_definition_t *parameter)
 {
-	current_call.parameter = parameter;
-	current_call.argument_tokens = NEW_ARR_F(token_t, 0);
+	current_call.parameter      = parameter;
+	current_call.argument_begin = ARR_LEN(current_call.argument_tokens);
 }
 
+/**
+ * Finishes the current argument. Its tokens stay in the argument list of the
+ * call, the token list of the parameter is set once all arguments are
+ * collected and the list does not move anymore.
+ */
 static void finish_argument(void)
 {
 	pp_definition_t *parameter = current_call.parameter;
 	if (parameter == NULL)
 		return;
-	token_t *tokens = current_call.argument_tokens;
-	size_t   len    = ARR_LEN(tokens);
-	parameter->list_len   = len;
-	parameter->token_list = obstack_copy(&pp_obstack, tokens, len*sizeof(tokens[0]));
+	parameter->list_len     = ARR_LEN(current_call.argument_tokens) - current_call.argument_begin;
 	parameter->is_expanding = false;
-	DEL_ARR_F(tokens);
 }
 
 static void start_call(pp_definition_t *definition, whitespace_info_t wsinfo,
@@ -1079,6 +1896,7 @@ static void start_call(pp_definition_t *definition, whitespace_info_t wsinfo,
 	call_whitespace_info = wsinfo;
 	call_space_before    = space_before;
 	if (definition->n_parameters > 0) {
+		current_call.argument_tokens = new_argument_list();
 		start_argument(&definition->parameters[0]);
 		push_function_expansion(definition);
 	}
@@ -1091,6 +1909,8 @@ static void start_call(pp_definition_t *definition, whitespace_info_t wsinfo,
 
 static pp_expansion_state_t *begin_expanding(pp_definition_t *definition)
 {
+	if (profiling && !definition->is_parameter)
+		profile_expansion(definition);
 	pp_expansion_state_t *expansion = push_expansion(definition);
 	if (definition->list_len > 0) {
 		token_t *token = &definition->token_list[0];
@@ -1109,6 +1929,7 @@ static void start_function_macro_expansion(const macro_call_t *call)
 	if (parameter_idx < macro->n_parameters) {
 		pp_definition_t *parameter = &macro->parameters[parameter_idx];
 		if (parameter->is_variadic) {
+			parameter->list_len      = 0;
 			parameter->not_specified = true;
 			/* avoid further error */
 			parameter_idx = macro->n_parameters;
@@ -1136,6 +1957,14 @@ static void start_function_macro_expansion(const macro_call_t *call)
 	macro->is_expanding              = true;
 	if (macro->n_parameters > 0) {
 		expansion->obstack_level = call->obstack_level;
+		expansion->arguments     = call->argument_tokens;
+		token_t *tokens = call->argument_tokens;
+		for (unsigned i = 0; i < macro->n_parameters; ++i) {
+			pp_definition_t *const parameter = &macro->parameters[i];
+			parameter->token_list    = tokens;
+			parameter->expanded_list = NULL;
+			tokens += parameter->list_len;
+		}
 	}
 	current_expansion = expansion;
 }
@@ -1204,6 +2033,15 @@ static void grow_token(struct obstack *obst, const token_t *token)
 		grow_string_escaped(obst, token->literal.string, "'");
 		break;
 
+	case T_EMBED: {
+		resource_t const *const resource = token->embed.resource;
+		for (size_t i = 0, n = resource->size; i != n; ++i) {
+			obstack_printf(obst, i != 0 ? ",%u" : "%u",
+			               (unsigned)resource->data[i]);
+		}
+		break;
+	}
+
 	case T_IDENTIFIER:
 	default: {
 		const char *str = token->base.symbol->string;
@@ -1639,12 +2477,14 @@ static bool concat_tokens(const position_t *pos,
  */
 static bool expand_next(void)
 {
-	if (current_expansion == NULL)
+	if (current_expansion == NULL
+	    || ARR_LEN(expansion_stack) <= argument_expansion_base)
 		return false;
 
 	size_t pos = current_expansion->pos;
 	while (pos >= current_expansion->list_len) {
-		if (!pop_expansion())
+		if (!pop_expansion()
+		    || ARR_LEN(expansion_stack) <= argument_expansion_base)
 			return false;
 		pos = current_expansion->pos;
 	}
@@ -1733,7 +2573,7 @@ finished:
  */
 static token_kind_t peek_expansion(bool may_pop)
 {
-	for (size_t i = ARR_LEN(expansion_stack); i-- > 0; ) {
+	for (size_t i = ARR_LEN(expansion_stack); i-- > argument_expansion_base; ) {
 		pp_expansion_state_t *e = &expansion_stack[i];
 		if (e->pos < e->list_len)
 			return e->token_list[e->pos].kind;
@@ -1752,7 +2592,7 @@ static void skip_line_comment(void)
 			return;
 
 		default:
-			next_char();
+			skip_run(CC_LINE_COMMENT);
 			break;
 		}
 	}
@@ -1760,11 +2600,11 @@ static void skip_line_comment(void)
 
 static unsigned skip_multiline_comment(void)
 {
-	position_t const start_pos = input.pos;
+	position_t const start_pos = *input_position();
 	while (true) {
 		switch (input.c) {
 		case '/': {
-			position_t pos = input.pos;
+			position_t pos = *input_position();
 			eat('/');
 			if (input.c == '*') {
 				warningf(WARN_COMMENT, &pos, "'/*' within block comment");
@@ -1775,8 +2615,15 @@ static unsigned skip_multiline_comment(void)
 		case '*':
 			eat('*');
 			if (input.c == '/') {
-				unsigned const whitespace_at_line_begin =
-					input.pos.lineno != input.output_line ? input.pos.colno : 0;
+				/* without output any non-zero value will do, this keeps the
+				 * line table of the input from being built */
+				unsigned whitespace_at_line_begin = 1;
+				if (out != NULL) {
+					position_info_t const pos
+						= get_position_info(input_position());
+					whitespace_at_line_begin
+						= pos.lineno != input.output_line ? pos.colno : 0;
+				}
 				eat('/');
 				return whitespace_at_line_begin;
 			}
@@ -1790,7 +2637,7 @@ static unsigned skip_multiline_comment(void)
 			return 0;
 
 		default:
-			next_char();
+			skip_run(CC_BLOCK_COMMENT);
 			break;
 		}
 	}
@@ -1802,7 +2649,7 @@ static bool skip_till_newline(bool stop_at_non_whitespace)
 	while (true) {
 		switch (input.c) {
 		case WHITESPACE:
-			next_char();
+			skip_run(CC_WHITESPACE);
 			continue;
 
 		case '/':
@@ -1843,15 +2690,13 @@ static whitespace_info_t skip_whitespace(void)
 	while (true) {
 		switch (input.c) {
 		case WHITESPACE:
-			++wsinfo.whitespace_at_line_begin;
-			next_char();
+			wsinfo.whitespace_at_line_begin += 1 + skip_run(CC_WHITESPACE);
 			break;
 
 		case EAT_NEWLINE:
 			wsinfo.at_line_begin            = true;
 			wsinfo.whitespace_at_line_begin = 0;
 			if (stop_at_newline) {
-				--input.pos.lineno;
 				put_back('\n');
 				return wsinfo;
 			}
@@ -1877,39 +2722,155 @@ static whitespace_info_t skip_whitespace(void)
 	}
 }
 
-static inline void eat_pp(pp_token_kind_t const kind)
-{
-	assert(pp_token.base.symbol->pp_ID == kind);
-	(void)kind;
-	next_input_token();
-}
-
-static inline void eat_token(token_kind_t const kind)
-{
-	assert(pp_token.kind == kind);
-	(void)kind;
-	next_input_token();
-}
-
-static void parse_symbol(void)
+/**
+ * Skips the lines of a conditional block, which is not compiled, up to the
+ * next line starting with '#' or the end of the input. No tokens are formed,
+ * only comments, string and character literals are recognized so the '#' of
+ * a directive is found reliably.
+ */
+static void skip_conditional_lines(void)
 {
-	assert(obstack_object_size(&symbol_obstack) == 0);
-	while (true) {
+	bool at_line_begin = false;
+	for (;;) {
 		switch (input.c) {
-		case DIGIT_CASES:
-		case SYMBOL_CASES:
-			obstack_1grow(&symbol_obstack, (char) input.c);
-			next_char();
+		case EAT_NEWLINE:
+			at_line_begin = true;
 			break;
 
-		case '\\': {
-			position_t const pos = input.pos;
-			eat('\\');
-			switch (input.c) {
-			{
-				unsigned n;
-			case 'U': n = 8; goto universal;
-			case 'u': n = 4; goto universal;
+		case WHITESPACE:
+			skip_run(CC_WHITESPACE);
+			break;
+
+		case '/':
+			eat('/');
+			if (input.c == '/') {
+				eat('/');
+				skip_line_comment();
+			} else if (input.c == '*') {
+				eat('*');
+				skip_multiline_comment();
+			} else {
+				at_line_begin = false;
+			}
+			break;
+
+		case '"':
+		case '\'': {
+			/* unterminated literals end at the end of the line and are not
+			 * diagnosed in skipped code */
+			utf32 const delimiter = input.c;
+			next_char();
+			while (input.c != delimiter) {
+				switch (input.c) {
+				case NEWLINE:
+				case UTF32_EOF:
+					goto end_of_literal;
+
+				case '\\':
+					/* the escaped character cannot end the literal */
+					next_char();
+					if (input.c == '\n' || input.c == '\r' || input.c == UTF32_EOF)
+						goto end_of_literal;
+					/* FALLTHROUGH */
+				default:
+					next_char();
+					break;
+				}
+			}
+			next_char();
+end_of_literal:
+			at_line_begin = false;
+			break;
+		}
+
+		case '%':
+			if (!at_line_begin)
+				goto other;
+			eat('%');
+			if (input.c != ':') {
+				at_line_begin = false;
+				break;
+			}
+			put_back('%');
+			/* FALLTHROUGH */
+		case '#':
+			if (!at_line_begin)
+				goto other;
+			next_info = (whitespace_info_t){
+				.whitespace_at_line_begin = 0,
+				.at_line_begin            = true,
+			};
+			next_space_before = false;
+			next_info_valid   = true;
+			return;
+
+		case UTF32_EOF:
+			return;
+
+		default:
+other:
+			at_line_begin = false;
+			skip_run(CC_SKIPPED);
+			break;
+		}
+	}
+}
+
+static inline void eat_pp(pp_token_kind_t const kind)
+{
+	assert(pp_token.base.symbol->pp_ID == kind);
+	(void)kind;
+	next_input_token();
+}
+
+static inline void eat_token(token_kind_t const kind)
+{
+	assert(pp_token.kind == kind);
+	(void)kind;
+	next_input_token();
+}
+
+static void parse_symbol(void)
+{
+	assert(obstack_object_size(&symbol_obstack) == 0);
+	symbol_t *symbol;
+
+	/* Usually the identifier is a single run of bytes in the input, which is
+	 * hashed right after finding its end and looked up in the symbol table
+	 * directly. */
+	char const *const cur = input.cur;
+	if (cur != putback_marker && cur[-1] == (char)input.c) {
+		char const   *const end  = find_run_end(cur, CC_IDENT);
+		unsigned char const next = *end;
+		if (next != '\\' && next != '?' && next != '$') {
+			char const *const begin = cur - 1;
+			size_t      const size  = end - begin;
+			uint64_t    const hash  = hash_string_size64(begin, size);
+			symbol    = symbol_table_insert_hashed(begin, size, hash);
+			input.cur = end;
+			next_char();
+			goto have_symbol;
+		}
+	}
+
+	while (true) {
+		switch (input.c) {
+		case DIGIT_CASES:
+		case SYMBOL_CASES: {
+			obstack_1grow(&symbol_obstack, (char) input.c);
+			char const *const run = input.cur;
+			obstack_grow(&symbol_obstack, run, skip_run(CC_IDENT));
+			break;
+		}
+
+		case '\\': {
+			position_t const pos = *input_position();
+			eat('\\');
+			switch (input.c) {
+			{
+				unsigned n;
+			case 'U': n = 8; goto universal;
+			case 'u': n = 4; goto universal;
 universal:
 				if (!resolve_escape_sequences) {
 					obstack_1grow(&symbol_obstack, '\\');
@@ -1941,8 +2902,15 @@ dollar_sign:
 	}
 
 end_symbol:;
-	char     *const string = obstack_nul_finish(&symbol_obstack);
-	symbol_t *const symbol = symbol_table_insert(string);
+	char *const string = obstack_nul_finish(&symbol_obstack);
+	symbol = symbol_table_insert(string);
+
+	/* we can free the memory from symbol obstack if we already had an entry in
+	 * the symbol table */
+	if (symbol->string != string)
+		obstack_free(&symbol_obstack, string);
+
+have_symbol:
 
 	/* Might be a prefixed string or character constant: L/U/u/u8"string". */
 	if (input.c == '"') {
@@ -1965,27 +2933,22 @@ end_symbol:;
 
 	pp_token.kind        = symbol->ID;
 	pp_token.base.symbol = symbol;
-
-	/* we can free the memory from symbol obstack if we already had an entry in
-	 * the symbol table */
-	if (symbol->string != string)
-		obstack_free(&symbol_obstack, string);
 }
 
 static void parse_number(void)
 {
 	begin_string_construction();
-	obstack_1grow(&string_obst, (char) input.c);
-	next_char();
 
 	while (true) {
 		switch (input.c) {
 		case '.':
 		case DIGIT_CASES:
-		case SYMBOL_CASES_WITHOUT_E_P:
+		case SYMBOL_CASES_WITHOUT_E_P: {
 			obstack_1grow(&string_obst, (char) input.c);
-			next_char();
+			char const *const run = input.cur;
+			obstack_grow(&string_obst, run, skip_run(CC_NUMBER));
 			break;
+		}
 
 		case 'e':
 		case 'p':
@@ -2070,14 +3033,13 @@ static void next_input_token(void)
 	pp_token.base.expansion_forbidden = false;
 
 restart:
-	pp_token.base.pos    = input.pos;
+	pp_token.base.pos    = *input_position();
 	pp_token.base.symbol = NULL;
 
 	switch (input.c) {
 	case WHITESPACE:
-		info.whitespace_at_line_begin++;
+		info.whitespace_at_line_begin += 1 + skip_run(CC_WHITESPACE);
 		pp_token.base.space_before = true;
-		next_char();
 		goto restart;
 
 	case EAT_NEWLINE:
@@ -2085,7 +3047,6 @@ restart:
 		info.at_line_begin            = true;
 		info.whitespace_at_line_begin = 0;
 		if (stop_at_newline) {
-			--input.pos.lineno;
 			set_special(T_NEWLINE);
 			put_back('\n');
 			return;
@@ -2249,12 +3210,14 @@ digraph_percentcolon:
 		}
 
 		if (input_stack != NULL) {
+			if (input.mi_state == MI_AFTER_GUARD)
+				find_include(input.real_name)->guard = input.mi_guard;
 			close_pp_input_file();
 			pop_restore_input();
 			if (out)
-				fputc('\n', out);
+				out_char('\n');
 			maybe_skip_newline();
-			print_line_directive(&input.pos, "2");
+			print_line_directive(input_position(), "2");
 			goto restart;
 		} else {
 			info.at_line_begin = true;
@@ -2288,29 +3251,31 @@ dollar_sign:
 
 static void print_quoted_string(const char *const string)
 {
-	fputc('"', out);
+	out_char('"');
 	for (const char *c = string; *c != 0; ++c) {
 		switch (*c) {
-		case '"':  fputs("\\\"", out); break;
-		case '\\': fputs("\\\\", out); break;
-		case '\a': fputs("\\a", out);  break;
-		case '\b': fputs("\\b", out);  break;
-		case '\f': fputs("\\f", out);  break;
-		case '\n': fputs("\\n", out);  break;
-		case '\r': fputs("\\r", out);  break;
-		case '\t': fputs("\\t", out);  break;
-		case '\v': fputs("\\v", out);  break;
-		case '\?': fputs("\\?", out);  break;
+		case '"':  out_str("\\\""); break;
+		case '\\': out_str("\\\\"); break;
+		case '\a': out_str("\\a");  break;
+		case '\b': out_str("\\b");  break;
+		case '\f': out_str("\\f");  break;
+		case '\n': out_str("\\n");  break;
+		case '\r': out_str("\\r");  break;
+		case '\t': out_str("\\t");  break;
+		case '\v': out_str("\\v");  break;
+		case '\?': out_str("\\?");  break;
 		default:
 			if (!isprint((unsigned char)*c)) {
-				fprintf(out, "\\%03o", (unsigned)*c);
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\%03o", (unsigned)(unsigned char)*c);
+				out_str(buf);
 				break;
 			}
-			fputc(*c, out);
+			out_char(*c);
 			break;
 		}
 	}
-	fputc('"', out);
+	out_char('"');
 }
 
 static void print_line_directive(const position_t *pos, const char *add)
@@ -2318,46 +3283,71 @@ static void print_line_directive(const position_t *pos, const char *add)
 	if (!out)
 		return;
 
-	fprintf(out, "# %u ", pos->lineno);
-	print_quoted_string(pos->input_name);
+	position_info_t const info = get_position_info(pos);
+	marker_begin = out_size;
+	out_str("# ");
+	out_unsigned(info.lineno);
+	out_char(' ');
+	print_quoted_string(info.input_name);
 	if (add != NULL) {
-		fputc(' ', out);
-		fputs(add, out);
+		out_char(' ');
+		out_str(add);
 	}
-	if (pos->is_system_header) {
-		fputs(" 3", out);
+	if (info.is_system_header) {
+		out_str(" 3");
 	}
+	/* flushing the buffer while printing drops the marker position */
+	marker_end  = marker_begin != (size_t)-1 ? out_size : (size_t)-1;
+	marker_flag = add;
 
-	input.output_line = pos->lineno - 1;
+	input.output_line = info.lineno - 1;
 }
 
-static bool emit_newlines(void)
+/** Continues the output at the line of @p pos. */
+static bool emit_newlines_to(const position_t *const pos)
 {
-	if (!out)
-		return true;
-
-	if (!info.at_line_begin)
-		return false;
-	unsigned delta = pp_token.base.pos.lineno - input.output_line;
+	unsigned const lineno = get_position_info(pos).lineno;
+	unsigned const delta  = lineno - input.output_line;
 	if (delta == 0)
 		return false;
 
 	if (delta >= 9) {
-		fputc('\n', out);
-		print_line_directive(&pp_token.base.pos, NULL);
-		fputc('\n', out);
+		if (marker_end == out_size) {
+			/* nothing follows the last line marker yet, move it to the new
+			 * line instead of adding another one */
+			out_size = marker_begin;
+			print_line_directive(pos, marker_flag);
+		} else {
+			out_char('\n');
+			print_line_directive(pos, NULL);
+		}
+		out_char('\n');
 	} else {
 		for (unsigned i = delta; i-- > 0; ) {
-			fputc('\n', out);
+			out_char('\n');
 		}
 	}
-	input.output_line = pp_token.base.pos.lineno;
+	input.output_line = lineno;
 
 	return true;
 }
 
+static bool emit_newlines(void)
+{
+	if (!out)
+		return true;
+
+	if (!info.at_line_begin)
+		return false;
+	return emit_newlines_to(&pp_token.base.pos);
+}
+
 void set_preprocessor_output(FILE *output)
 {
+	if (out != NULL)
+		flush_output();
+	if (output != NULL)
+		fflush(output);
 	out = output;
 	resolve_escape_sequences = out == NULL;
 }
@@ -2427,8 +3417,20 @@ void preprocessor_print_dependencies(FILE *output, bool show_system_headers,
 	}
 }
 
+/** Prints the bytes of @p resource as a comma separated list of numbers. */
+static void emit_resource(resource_t const *const resource)
+{
+	for (size_t i = 0, n = resource->size; i != n; ++i) {
+		if (i != 0)
+			out_char(',');
+		out_unsigned(resource->data[i]);
+	}
+}
+
 void emit_pp_token(void)
 {
+	/* embedded data is printed as numbers */
+	token_kind_t const kind = pp_token.kind == T_EMBED ? T_NUMBER : pp_token.kind;
 	bool had_newlines = emit_newlines();
 	/* emit space before tokens */
 	if (had_newlines) {
@@ -2443,36 +3445,100 @@ void emit_pp_token(void)
 		if (whitespace == 0 && pp_token.base.space_before)
 			++whitespace;
 		for (unsigned i = whitespace; i-- > 0; )
-			fputc(' ', out);
+			out_char(' ');
 	} else if (pp_token.base.space_before
-	  || tokens_would_paste(previous_token, pp_token.kind)) {
-		fputc(' ', out);
+	  || tokens_would_paste(previous_token, kind)) {
+		out_char(' ');
 	}
 
 	switch (pp_token.kind) {
 	case T_NUMBER:
-		fputs(pp_token.literal.string->begin, out);
+		out_mem(pp_token.literal.string->begin, pp_token.literal.string->size);
 		break;
 
 	case T_STRING_LITERAL:
-		fputs(get_string_encoding_prefix(pp_token.literal.string->encoding), out);
-		fputc('"', out);
-		fputs(pp_token.literal.string->begin, out);
-		fputc('"', out);
+		out_str(get_string_encoding_prefix(pp_token.literal.string->encoding));
+		out_char('"');
+		out_mem(pp_token.literal.string->begin, pp_token.literal.string->size);
+		out_char('"');
 		break;
 
 	case T_CHARACTER_CONSTANT:
-		fputs(get_string_encoding_prefix(pp_token.literal.string->encoding), out);
-		fputc('\'', out);
-		fputs(pp_token.literal.string->begin, out);
-		fputc('\'', out);
+		out_str(get_string_encoding_prefix(pp_token.literal.string->encoding));
+		out_char('\'');
+		out_mem(pp_token.literal.string->begin, pp_token.literal.string->size);
+		out_char('\'');
+		break;
+
+	case T_EMBED:
+		emit_resource(pp_token.embed.resource);
 		break;
 
 	default:
-		fputs(pp_token.base.symbol->string, out);
+		out_mem(pp_token.base.symbol->string, pp_token.base.symbol->size);
 		break;
 	}
-	previous_token = pp_token.kind;
+	previous_token = kind;
+}
+
+/** Prints a #define directive recreating @p definition. */
+static void print_definition(pp_definition_t *const definition)
+{
+	out_str("#define ");
+	out_str(definition->symbol->string);
+	if (definition->has_parameters) {
+		out_char('(');
+		separator_t sep = { "", ", " };
+		for (size_t i = 0; i != definition->n_parameters; ++i) {
+			out_str(sep_next(&sep));
+			pp_definition_t *const param = &definition->parameters[i];
+			if (!param->is_variadic) {
+				out_str(param->symbol->string);
+			} else if (param->symbol == symbol___VA_ARGS__) {
+				out_str("...");
+			} else {
+				out_str(param->symbol->string);
+				out_str("...");
+			}
+		}
+		out_char(')');
+	}
+	out_char(' ');
+	memset(&previous_token, 0, sizeof(previous_token));
+	for (size_t t = 0; t < definition->list_len; ++t) {
+		pp_token = definition->token_list[t];
+		if (t == 0)
+			pp_token.base.space_before = false;
+		emit_pp_token();
+	}
+}
+
+static bool keep_macro_directives(void)
+{
+	return directives_only && out != NULL;
+}
+
+/**
+ * Copies a #define (@p definition != NULL) or #undef of @p symbol to the
+ * output of a directives-only run, so the macros can be expanded later.
+ */
+static void emit_macro_directive(const position_t *const pos,
+                                 symbol_t *const symbol,
+                                 pp_definition_t *const definition)
+{
+	token_t           const saved_token = pp_token;
+	whitespace_info_t const saved_info  = info;
+	if (!emit_newlines_to(pos))
+		out_char('\n');
+	memset(&info, 0, sizeof(info));
+	if (definition != NULL) {
+		print_definition(definition);
+	} else {
+		out_str("#undef ");
+		out_str(symbol->string);
+	}
+	pp_token = saved_token;
+	info     = saved_info;
 }
 
 static void eat_pp_directive(void)
@@ -2569,7 +3635,7 @@ void add_define(char const *const name, char const *const val,
 	pp_definition_t *const def = add_define_(name, standard_define);
 
 	input_t *decoder = input_from_string(val, input_decode_utf8);
-	switch_input(decoder, builtin_position.input_name, NULL, true);
+	switch_input(decoder, builtin_input_name, NULL, true);
 
 	assert(obstack_object_size(&pp_obstack) == 0);
 	for (;;) {
@@ -2640,7 +3706,7 @@ void add_define_macro(char const *const name, char const *const macro_arg,
 	pp_definition_t *const def = add_define_(name, standard_define);
 
 	input_t *decoder = input_from_string(val, input_decode_utf8);
-	switch_input(decoder, builtin_position.input_name, NULL, true);
+	switch_input(decoder, builtin_input_name, NULL, true);
 
 	symbol_t *const parameter_symbol = symbol_table_insert(macro_arg);
 	pp_definition_t *parameter = OALLOCZ(&pp_obstack, pp_definition_t);
@@ -2757,7 +3823,7 @@ static void update_definition_int(pp_definition_t *const definition,
 
 static void update_file(pp_definition_t *definition)
 {
-	const char *input_name = pp_token.base.pos.input_name;
+	const char *input_name = get_position_info(&pp_token.base.pos).input_name;
 	if (input_name == NULL)
 		input_name = "";
 	update_definition_string(definition, input_name);
@@ -2770,7 +3836,7 @@ static void update_base_file(pp_definition_t *definition)
 
 static void update_line(pp_definition_t *definition)
 {
-	update_definition_int(definition, pp_token.base.pos.lineno);
+	update_definition_int(definition, get_position_info(&pp_token.base.pos).lineno);
 }
 
 static void update_include_level(pp_definition_t *definition)
@@ -2949,7 +4015,7 @@ variadic:
 
 				if (pp_token.kind == ',') {
 					if (is_variadic) {
-						errorf(&input.pos, "'...' parameter must be last in macro argument list");
+						errorf(input_position(), "'...' parameter must be last in macro argument list");
 						goto error_out;
 					}
 					eat_token(',');
@@ -3035,6 +4101,24 @@ finish_argument_list:
 	new_definition->list_len   = list_len;
 	new_definition->token_list = obstack_finish(&pp_obstack);
 
+	/* find the parameters whose argument is expanded more than once, the
+	 * operands of '#' and '##' are used unexpanded */
+	if (new_definition->n_parameters > 0) {
+		bool *const used = NEW_ARR_FZ(bool, new_definition->n_parameters);
+		for (size_t i = 0; i < list_len; ++i) {
+			const token_t *const token = &new_definition->token_list[i];
+			if (token->kind != T_MACRO_PARAMETER
+			    || (i > 0 && (token[-1].kind == '#' || token[-1].kind == T_HASHHASH))
+			    || (i + 1 < list_len && token[1].kind == T_HASHHASH))
+				continue;
+			pp_definition_t *const param = token->macro_parameter.def;
+			size_t           const idx   = param - new_definition->parameters;
+			param->expand_once = used[idx];
+			used[idx]          = true;
+		}
+		DEL_ARR_F(used);
+	}
+
 	if (list_len > 0) {
 		const token_t *first_token = &new_definition->token_list[0];
 		const token_t *last_token  = &new_definition->token_list[list_len-1];
@@ -3062,7 +4146,7 @@ finish_argument_list:
 	pp_definition_t *old_definition = macro_symbol->pp_definition;
 	if (old_definition != NULL) {
 		if (old_definition->standard_define) {
-			warningf(WARN_BUILTIN_MACRO_REDEFINED, &input.pos,
+			warningf(WARN_BUILTIN_MACRO_REDEFINED, input_position(),
 			         "redefining builtin macro '%Y'", macro_symbol);
 		} else if (!pp_definitions_equal(old_definition, new_definition)) {
 			if (warningf(WARN_OTHER, &new_definition->pos, "multiple definitions of macro '%Y'", macro_symbol))
@@ -3075,6 +4159,8 @@ finish_argument_list:
 	}
 
 	macro_symbol->pp_definition = new_definition;
+	if (keep_macro_directives())
+		emit_macro_directive(&new_definition->pos, macro_symbol, new_definition);
 	return;
 
 error_out:
@@ -3089,7 +4175,7 @@ static void do_undefine(symbol_t *symbol)
 {
 	pp_definition_t *old = symbol->pp_definition;
 	if (old != NULL && old->standard_define) {
-		warningf(WARN_BUILTIN_MACRO_REDEFINED, &input.pos,
+		warningf(WARN_BUILTIN_MACRO_REDEFINED, input_position(),
 		         "undefining builtin macro '%Y'", symbol);
 	}
 	symbol->pp_definition = NULL;
@@ -3116,6 +4202,8 @@ static void parse_undef_directive(void)
 
 	symbol_t *symbol = pp_token.base.symbol;
 	do_undefine(symbol);
+	if (keep_macro_directives())
+		emit_macro_directive(&pp_token.base.pos, symbol, NULL);
 	next_input_token();
 
 	expect_directive_end(WARN_OTHER, "#undef");
@@ -3133,7 +4221,7 @@ static const char *parse_headername(bool *system_include)
 	}
 
 	/* check whether we have a "... or <... headername */
-	position_t pos = input.pos;
+	position_t pos = *input_position();
 	switch (input.c) {
 	{
 		utf32 delimiter;
@@ -3168,7 +4256,7 @@ parse_name:
 	}
 
 	default:
-		next_preprocessing_token();
+		next_expanded_token();
 		if (pp_token.kind == T_STRING_LITERAL) {
 			*system_include = false;
 			return pp_token.literal.string->begin;
@@ -3176,7 +4264,7 @@ parse_name:
 			*system_include = true;
 			token_t *tokens = NEW_ARR_F(token_t, 0);
 			while (true) {
-				next_preprocessing_token();
+				next_expanded_token();
 				if (pp_token.kind == T_EOF) {
 					DEL_ARR_F(tokens);
 					goto error_invalid_input;
@@ -3215,15 +4303,149 @@ finish_headername:;
 	return headername;
 }
 
-static bool do_include(bool const bracket_include, bool const include_next,
-                       char const *const headername)
+#ifdef LIST_SEARCHPATH
+static int compare_names(void const *const a, void const *const b)
+{
+	return strcmp(*(char const *const*)a, *(char const *const*)b);
+}
+
+/**
+ * Returns true if the directory @p path finds the file names in the sorted
+ * list @p names with a different case, too. Only one name is tried.
+ */
+static bool has_case_insensitive_names(char const *const path,
+                                       char const *const *const names,
+                                       size_t const n_names)
+{
+	size_t const path_len = strlen(path);
+	for (size_t i = 0; i != n_names; ++i) {
+		/* the name with the case of its letters swapped */
+		assert(obstack_object_size(&symbol_obstack) == 0);
+		obstack_grow(&symbol_obstack, path, path_len);
+		obstack_1grow(&symbol_obstack, '/');
+		bool swapped = false;
+		for (char const *c = names[i]; *c != '\0'; ++c) {
+			char chr = *c;
+			if ('a' <= chr && chr <= 'z') {
+				chr     = chr - 'a' + 'A';
+				swapped = true;
+			} else if ('A' <= chr && chr <= 'Z') {
+				chr     = chr - 'A' + 'a';
+				swapped = true;
+			}
+			obstack_1grow(&symbol_obstack, chr);
+		}
+		char       *const file  = obstack_nul_finish(&symbol_obstack);
+		char const *const other = file + path_len + 1;
+		/* names without letters or whose other case is listed, too, tell
+		 * nothing */
+		if (!swapped || bsearch(&other, names, n_names, sizeof(*names),
+		                        compare_names) != NULL) {
+			obstack_free(&symbol_obstack, file);
+			continue;
+		}
+		struct stat st;
+		bool const found = stat(file, &st) == 0;
+		obstack_free(&symbol_obstack, file);
+		return found;
+	}
+	return false;
+}
+
+/** Reads the sorted names of the files in the directory of @p entry. */
+static void list_searchpath_entry(searchpath_entry_t *const entry)
+{
+	entry->listed = true;
+
+	DIR *const dir = opendir(entry->path);
+	if (dir == NULL) {
+		/* a directory which does not exist contains nothing, for other
+		 * errors (like a directory which is not readable) fall back to
+		 * opening the files */
+		if (errno == ENOENT || errno == ENOTDIR)
+			entry->names = OALLOC(&config_obstack, char const*);
+		return;
+	}
+
+	char const **names = NEW_ARR_F(char const*, 0);
+	for (struct dirent const *d; (d = readdir(dir)) != NULL;) {
+		char const *const name
+			= obstack_copy(&config_obstack, d->d_name, strlen(d->d_name) + 1);
+		ARR_APP1(char const*, names, name);
+	}
+	closedir(dir);
+
+	size_t const n_names = ARR_LEN(names);
+	qsort(names, n_names, sizeof(*names), compare_names);
+	if (!has_case_insensitive_names(entry->path, names, n_names)) {
+		entry->names   = obstack_copy(&config_obstack, names, n_names * sizeof(*names));
+		entry->n_names = n_names;
+	}
+	DEL_ARR_F(names);
+}
+#endif
+
+/**
+ * Returns false if the directory of search path entry @p entry certainly does
+ * not contain @p headername.
+ */
+static bool searchpath_may_contain(searchpath_entry_t *const entry,
+                                   char const *const headername)
+{
+#ifdef LIST_SEARCHPATH
+	if (!entry->listed)
+		list_searchpath_entry(entry);
+	if (entry->names == NULL)
+		return true;
+
+	/* only the first component of the headername is looked up */
+	char const *const slash = strchr(headername, '/');
+	size_t      const len   = slash ? (size_t)(slash - headername) : strlen(headername);
+	char const **const names = entry->names;
+	size_t             lo    = 0;
+	size_t             hi    = entry->n_names;
+	while (lo < hi) {
+		size_t const mid = lo + (hi - lo) / 2;
+		int          cmp = strncmp(headername, names[mid], len);
+		if (cmp == 0) {
+			if (names[mid][len] == '\0')
+				return true;
+			cmp = -1;
+		}
+		if (cmp < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	errno = ENOENT;
+	return false;
+#else
+	(void)entry;
+	(void)headername;
+	return true;
+#endif
+}
+
+/** Opens the file @p name found in search path entry @p path. */
+typedef include_result_t (*open_func)(char const *name,
+                                      searchpath_entry_t *path,
+                                      bool is_system_header);
+
+/**
+ * Looks up @p headername like #include does and opens it with @p open.
+ */
+static include_result_t do_include(bool const bracket_include,
+                                   bool const include_next,
+                                   char const *const headername,
+                                   open_func const open)
 {
 	/* A file included from a system header is a system header, too. */
-	bool const is_system_header = input.pos.is_system_header;
+	bool const is_system_header = is_system_header_position(input_position());
 
 	/* is it an absolute path? */
 	if (headername[0] == '/')
-		return try_switch_input(headername, NULL, is_system_header);
+		return open(headername, NULL, is_system_header);
 
 	size_t const headername_size = strlen(headername) + 1;
 
@@ -3242,17 +4464,20 @@ static bool do_include(bool const bracket_include, bool const include_next,
 			obstack_grow(&symbol_obstack, filename, last_slash - filename + 1);
 		obstack_grow(&symbol_obstack, headername, headername_size);
 
-		char *const name    = obstack_finish(&symbol_obstack);
-		bool  const success = try_switch_input(name, NULL, is_system_header);
+		char             *const name   = obstack_finish(&symbol_obstack);
+		include_result_t  const result = open(name, NULL, is_system_header);
 		obstack_free(&symbol_obstack, name);
-		if (success)
-			return true;
+		if (result != INCLUDE_NOT_FOUND)
+			return result;
 		entry = quote_searchpath.first;
 	}
 
 	assert(obstack_object_size(&symbol_obstack) == 0);
 	/* check searchpath */
 	for (; entry != NULL; entry = entry->next) {
+		if (!searchpath_may_contain(entry, headername))
+			continue;
+
 		char const *const path = entry->path;
 		size_t      const len  = strlen(path);
 		obstack_grow(&symbol_obstack, path, len);
@@ -3260,14 +4485,14 @@ static bool do_include(bool const bracket_include, bool const include_next,
 			obstack_1grow(&symbol_obstack, '/');
 		obstack_grow(&symbol_obstack, headername, headername_size);
 
-		char *const name    = obstack_finish(&symbol_obstack);
-		bool  const success = try_switch_input(name, entry, entry->is_system_path);
+		char             *const name   = obstack_finish(&symbol_obstack);
+		include_result_t  const result = open(name, entry, entry->is_system_path);
 		obstack_free(&symbol_obstack, name);
-		if (success)
-			return true;
+		if (result != INCLUDE_NOT_FOUND)
+			return result;
 	}
 
-	return false;
+	return INCLUDE_NOT_FOUND;
 }
 
 static void parse_include_directive(bool const include_next)
@@ -3290,7 +4515,7 @@ exit_skip:
 	}
 	bool had_nonwhitespace = skip_till_newline(false);
 	if (had_nonwhitespace) {
-		warningf(WARN_OTHER, &input.pos, "extra tokens at end of #include");
+		warningf(WARN_OTHER, input_position(), "extra tokens at end of #include");
 	}
 	if (n_inputs > INCLUDE_LIMIT) {
 		errorf(&pp_token.base.pos, "#include nested too deeply");
@@ -3302,16 +4527,22 @@ exit_skip:
 	info.at_line_begin            = true;
 	emit_newlines();
 	push_input();
-	bool res = do_include(system_include, include_next, headername);
-	if (res) {
+	switch (do_include(system_include, include_next, headername, try_switch_input)) {
+	case INCLUDE_ENTERED:
 		next_input_token();
-	} else {
+		return;
+	case INCLUDE_SKIPPED:
+		pop_restore_input();
+		goto exit_skip;
+	case INCLUDE_NOT_FOUND: {
 		char const ldelim = system_include ? '<' : '"';
 		char const rdelim = system_include ? '>' : '"';
 		errorf(&pp_token.base.pos, "failed including %c%s%c: %s", ldelim, headername, rdelim, strerror(errno));
 		pop_restore_input();
 		goto exit_skip;
 	}
+	}
+	panic("invalid include result");
 }
 
 static pp_conditional_t *push_conditional(void)
@@ -3344,14 +4575,82 @@ void check_unclosed_conditionals(void)
 	}
 }
 
-static ir_tarval *pp_null;
-static ir_tarval *pp_one;
+/**
+ * Value of a preprocessor condition. The arithmetic is done natively in the
+ * 64 bits of mode_Ls/mode_Lu with wrap-around, like the tarval operations it
+ * replaces.
+ */
+typedef struct pp_value_t {
+	uint64_t bits;
+	bool     is_unsigned : 1;
+	bool     bad         : 1; /**< an error occurred, like tarval_bad */
+} pp_value_t;
+
+static pp_value_t const pp_null = { 0, false, false };
+static pp_value_t const pp_one  = { 1, false, false };
+static pp_value_t const pp_bad  = { 0, false, true  };
 
 static void       next_condition_token(void);
 static bool       start_expanding(void);
-static ir_tarval *parse_pp_expression(precedence_t prec);
+static pp_value_t parse_pp_expression(precedence_t prec);
 
-static ir_tarval *parse_pp_operand(void)
+static inline pp_value_t pp_value(uint64_t const bits, bool const is_unsigned)
+{
+	return (pp_value_t){ bits, is_unsigned, false };
+}
+
+static inline pp_value_t pp_bool(bool const b)
+{
+	return b ? pp_one : pp_null;
+}
+
+/**
+ * Converts the result of the tarval fallback for integer constants, which the
+ * native parser does not handle.
+ */
+static pp_value_t pp_value_from_tarval(ir_tarval *const tv, bool const is_unsigned)
+{
+	if (tv == tarval_bad)
+		return pp_bad;
+	ir_tarval *const tv_signed = tarval_convert_to(tv, mode_Ls);
+	if (!tarval_is_long(tv_signed))
+		return pp_bad;
+	return pp_value((uint64_t)get_tarval_long(tv_signed), is_unsigned);
+}
+
+/**
+ * Parses the digits of an integer constant without suffix natively.
+ *
+ * @return false if the digits are malformed or the value does not fit into
+ *         @p max, the caller falls back to tarvals then
+ */
+static bool parse_pp_number(char const *i, char const *const end,
+                            uint64_t const max, uint64_t *const res)
+{
+	unsigned base = 10;
+	if (*i == '0') {
+		++i;
+		base = 8;
+		if (*i == 'x' || *i == 'X') {
+			++i;
+			base = 16;
+			if (i == end)
+				return false;
+		}
+	}
+
+	uint64_t v = 0;
+	for (; i != end; ++i) {
+		int const digit = hex_digit_value(*i);
+		if (digit < 0 || (unsigned)digit >= base || v > (max - digit) / base)
+			return false;
+		v = v * base + digit;
+	}
+	*res = v;
+	return true;
+}
+
+static pp_value_t parse_pp_operand(void)
 {
 	token_kind_t const kind = pp_token.kind;
 	switch (kind) {
@@ -3363,7 +4662,7 @@ static ir_tarval *parse_pp_operand(void)
 		case STRING_ENCODING_CHAR:
 		case STRING_ENCODING_UTF8: {
 			long const v = str[0];
-			return new_tarval_from_long(v, mode_Ls);
+			return pp_value((uint64_t)v, false);
 		}
 
 		case STRING_ENCODING_CHAR16:
@@ -3371,7 +4670,7 @@ static ir_tarval *parse_pp_operand(void)
 		case STRING_ENCODING_WIDE: {
 			char const *i = str;
 			long const  v = read_utf8_char(&i);
-			return new_tarval_from_long(v, mode_Ls);
+			return pp_value((uint64_t)v, false);
 		}
 		}
 		panic("invalid encoding");
@@ -3404,16 +4703,22 @@ static ir_tarval *parse_pp_operand(void)
 			++i;
 		}
 
-		ir_tarval *res;
+		pp_value_t res;
 		if (*i != '\0') {
 error:
 			errorf(&pp_token.base.pos, "invalid suffix '%s' on integer constant in preprocessor condition", suffix);
-			res = tarval_bad;
+			res = pp_bad;
 		} else {
-			ir_mode *const mode = is_unsigned ? mode_Lu : mode_Ls;
-			res  = new_tarval_from_str(str, suffix - str, mode);
-			if (res == tarval_bad) {
-				errorf(&pp_token.base.pos, "invalid %K in preprocessor condition", &pp_token);
+			uint64_t const max = is_unsigned ? UINT64_MAX : INT64_MAX;
+			uint64_t       v;
+			if (parse_pp_number(str, suffix, max, &v)) {
+				res = pp_value(v, is_unsigned);
+			} else {
+				ir_mode *const mode = is_unsigned ? mode_Lu : mode_Ls;
+				res = pp_value_from_tarval(new_tarval_from_str(str, suffix - str, mode), is_unsigned);
+				if (res.bad) {
+					errorf(&pp_token.base.pos, "invalid %K in preprocessor condition", &pp_token);
+				}
 			}
 		}
 		next_condition_token();
@@ -3422,7 +4727,7 @@ error:
 
 	case '(': {
 		next_condition_token();
-		ir_tarval *const res = parse_pp_expression(PREC_BOTTOM);
+		pp_value_t const res = parse_pp_expression(PREC_BOTTOM);
 		if (pp_token.kind == ')') {
 			next_condition_token();
 		} else {
@@ -3436,15 +4741,15 @@ error:
 	case '~':
 	case '!': {
 		next_condition_token();
-		ir_tarval *const v = parse_pp_operand();
-		if (v == tarval_bad)
+		pp_value_t const v = parse_pp_operand();
+		if (v.bad)
 			return v;
 
 		switch (kind) {
 		case '+': return v;
-		case '-': return tarval_neg(v);
-		case '~': return tarval_not(v);
-		case '!': return tarval_is_null(v) ? pp_one : pp_null;
+		case '-': return pp_value(-v.bits, v.is_unsigned);
+		case '~': return pp_value(~v.bits, v.is_unsigned);
+		case '!': return pp_bool(v.bits == 0);
 		default:  panic("invalid operation");
 		}
 	}
@@ -3452,7 +4757,7 @@ error:
 	default:
 		if (!is_identifierlike_token(&pp_token)) {
 			errorf(&pp_token.base.pos, "unexpected %K in preprocessor condition", &pp_token);
-			return tarval_bad;
+			return pp_bad;
 		} else if (pp_token.base.symbol->pp_ID == TP_defined) {
 			// Prevent macro expansion after 'defined'.
 			bool has_paren = false;
@@ -3461,7 +4766,7 @@ error:
 				next_input_token();
 				if (pp_token.kind == '\n') {
 					errorf(&pp_token.base.pos, "unexpected end of preprocessor condition, expected '(' or identifier");
-					return tarval_bad;
+					return pp_bad;
 				}
 				if (pp_token.kind == '(') {
 					goto has_paren;
@@ -3474,7 +4779,7 @@ has_paren:
 					next_input_token();
 					if (pp_token.kind == '\n') {
 						errorf(&pp_token.base.pos, "unexpected end of preprocessor condition, expected identifier");
-						return tarval_bad;
+						return pp_bad;
 					}
 				}
 				has_paren = true;
@@ -3497,7 +4802,7 @@ read_input:
 								next_input_token();
 								if (pp_token.kind == '\n') {
 									errorf(&pp_token.base.pos, "unexpected end of preprocessor condition, expected identifier");
-									return tarval_bad;
+									return pp_bad;
 								}
 							}
 							goto next;
@@ -3508,13 +4813,13 @@ read_input:
 				}
 			}
 next:;
-			ir_tarval *res;
+			pp_value_t res;
 			if (is_identifierlike_token(&pp_token)) {
-				res = pp_token.base.symbol->pp_definition ? pp_one : pp_null;
+				res = pp_bool(pp_token.base.symbol->pp_definition != NULL);
 				next_condition_token();
 			} else {
 				errorf(&pp_token.base.pos, "unexpected %K in preprocessor condition, expected identifier", &pp_token);
-				res = tarval_bad;
+				res = pp_bad;
 			}
 
 			if (has_paren) {
@@ -3536,9 +4841,9 @@ next:;
 	}
 }
 
-static ir_tarval *parse_pp_expression(precedence_t const prev_prec)
+static pp_value_t parse_pp_expression(precedence_t const prev_prec)
 {
-	ir_tarval *res = parse_pp_operand();
+	pp_value_t res = parse_pp_operand();
 	for (;;) {
 		precedence_t       prec;
 		token_kind_t const kind = pp_token.kind;
@@ -3578,74 +4883,99 @@ static ir_tarval *parse_pp_expression(precedence_t const prev_prec)
 
 		if (kind == '?')
 			prec = PREC_BOTTOM;
-		ir_tarval *right = parse_pp_expression(prec);
+		pp_value_t right = parse_pp_expression(prec);
 
-		if ((res != tarval_bad && right != tarval_bad) || kind == '?') {
-			ir_mode *mode = get_tarval_mode(res);
+		if ((!res.bad && !right.bad) || kind == '?') {
 			if (kind != T_LESSLESS && kind != T_GREATERGREATER && kind != '?') {
-				bool const lsigned = mode_is_signed(mode);
-				bool const rsigned = mode_is_signed(get_tarval_mode(right));
-				if (lsigned != rsigned) {
-					mode = mode_Lu;
-					if (lsigned) {
-						res = tarval_convert_to(res, mode);
-					} else {
-						right = tarval_convert_to(right, mode);
-					}
-				}
+				/* usual arithmetic conversions */
+				bool const is_unsigned = res.is_unsigned | right.is_unsigned;
+				res.is_unsigned   = is_unsigned;
+				right.is_unsigned = is_unsigned;
 			}
 
+			uint64_t const l = res.bits;
+			uint64_t const r = right.bits;
+			/* the shift count is taken modulo the width like for mode_Ls */
+			unsigned const shift = r & 63;
 			switch (kind) {
-			case '*':              res = tarval_mul(res, right); break;
-			case '/':              res = tarval_div(res, right); break;
-			case '%':              res = tarval_mod(res, right); break;
-			case '+':              res = tarval_add(res, right); break;
-			case '-':              res = tarval_sub(res, right); break;
-			case T_LESSLESS:       res = tarval_shl(res, right); break;
-			case T_GREATERGREATER: res = (mode_is_signed(mode) ? tarval_shrs : tarval_shr)(res, right); break;
+			case '*': res.bits = l * r; break;
+			case '+': res.bits = l + r; break;
+			case '-': res.bits = l - r; break;
+
+			case '/':
+			case '%':
+				if (r == 0) {
+					res = pp_bad;
+				} else if (res.is_unsigned) {
+					res.bits = kind == '/' ? l / r : l % r;
+				} else if (l == (uint64_t)INT64_MIN && r == (uint64_t)-1) {
+					/* the quotient overflows and wraps around */
+					res.bits = kind == '/' ? l : 0;
+				} else {
+					int64_t const sl = (int64_t)l;
+					int64_t const sr = (int64_t)r;
+					res.bits = (uint64_t)(kind == '/' ? sl / sr : sl % sr);
+				}
+				break;
+
+			case T_LESSLESS:
+				res.bits = l << shift;
+				break;
+			case T_GREATERGREATER:
+				if (res.is_unsigned) {
+					res.bits = l >> shift;
+				} else {
+					/* arithmetic shift without relying on implementation
+					 * defined behaviour */
+					uint64_t const sign = -(l >> 63);
+					res.bits = ((l ^ sign) >> shift) ^ sign;
+				}
+				break;
 
 			{
-				ir_relation rel;
-			case T_LESS:                 rel = ir_relation_less;          goto cmp;
-			case T_GREATER:              rel = ir_relation_greater;       goto cmp;
-			case T_LESSEQUAL:            rel = ir_relation_less_equal;    goto cmp;
-			case T_GREATEREQUAL:         rel = ir_relation_greater_equal; goto cmp;
-			case T_EQUALEQUAL:           rel = ir_relation_equal;         goto cmp;
-			case T_EXCLAMATIONMARKEQUAL: rel = ir_relation_less_greater;  goto cmp;
+				bool b;
+			case T_LESS:
+				b = res.is_unsigned ? l < r : (int64_t)l < (int64_t)r;
+				goto cmp;
+			case T_GREATER:
+				b = res.is_unsigned ? l > r : (int64_t)l > (int64_t)r;
+				goto cmp;
+			case T_LESSEQUAL:
+				b = res.is_unsigned ? l <= r : (int64_t)l <= (int64_t)r;
+				goto cmp;
+			case T_GREATEREQUAL:
+				b = res.is_unsigned ? l >= r : (int64_t)l >= (int64_t)r;
+				goto cmp;
+			case T_EQUALEQUAL:           b = l == r; goto cmp;
+			case T_EXCLAMATIONMARKEQUAL: b = l != r; goto cmp;
+			case T_ANDAND:               b = l != 0 && r != 0; goto cmp;
+			case T_PIPEPIPE:             b = l != 0 || r != 0; goto cmp;
 cmp:
-				res = tarval_cmp(res, right) & rel ? pp_one : pp_null;
+				res = pp_bool(b);
 				break;
 			}
 
-			case '&':        res = tarval_and(res, right); break;
-			case '^':        res = tarval_eor(res, right); break;
-			case '|':        res = tarval_or (res, right); break;
-			case T_ANDAND:   res = !tarval_is_null(res) && !tarval_is_null(right) ? pp_one : pp_null; break;
-			case T_PIPEPIPE: res = !tarval_is_null(res) || !tarval_is_null(right) ? pp_one : pp_null; break;
+			case '&': res.bits = l & r; break;
+			case '^': res.bits = l ^ r; break;
+			case '|': res.bits = l | r; break;
 
 			case '?': {
-				ir_tarval *t = right;
+				pp_value_t t = right;
 				if (pp_token.kind != ':') {
 					errorf(&pp_token.base.pos, "unexpected %K in preprocessor condition, expected ':'", &pp_token);
 				} else {
 					next_condition_token();
 				}
-				ir_tarval *f = parse_pp_expression(PREC_CONDITIONAL);
-
-				if (res != tarval_bad) {
-					if (t != tarval_bad && f != tarval_bad) {
-						bool const tsigned = mode_is_signed(get_tarval_mode(t));
-						bool const fsigned = mode_is_signed(get_tarval_mode(f));
-						if (tsigned != fsigned) {
-							if (tsigned) {
-								t = tarval_convert_to(t, mode_Lu);
-							} else {
-								f = tarval_convert_to(f, mode_Lu);
-							}
-						}
+				pp_value_t f = parse_pp_expression(PREC_CONDITIONAL);
+
+				if (!res.bad) {
+					if (!t.bad && !f.bad) {
+						bool const is_unsigned = t.is_unsigned | f.is_unsigned;
+						t.is_unsigned = is_unsigned;
+						f.is_unsigned = is_unsigned;
 					}
 
-					res = tarval_is_null(res) ? f : t;
+					res = res.bits == 0 ? f : t;
 				}
 				break;
 			}
@@ -3653,7 +4983,7 @@ cmp:
 			default: panic("invalid operation");
 			}
 		} else {
-			res = tarval_bad;
+			res = pp_bad;
 		}
 	}
 }
@@ -3664,17 +4994,21 @@ static bool parse_pp_condition(void)
 	resolve_escape_sequences = true;
 
 	next_condition_token();
-	bool const res = !tarval_is_null(parse_pp_expression(PREC_BOTTOM));
+	pp_value_t const res  = parse_pp_expression(PREC_BOTTOM);
+	/* a bad value is not null, like tarval_bad */
+	bool       const cond = res.bad || res.bits != 0;
 	expect_directive_end(WARN_ERROR, "condition");
 
 	resolve_escape_sequences = old_resolve_escape_sequences;
 
-	return res;
+	return cond;
 }
 
 static void parse_elif_directive(void)
 {
 	pp_conditional_t *const cond = conditional_stack;
+	if (cond != NULL && cond == input.mi_conditional)
+		input.mi_state = MI_INVALID;
 	if (!cond) {
 		errorf(&pp_token.base.pos, "#elif without prior #if");
 		eat_pp_directive();
@@ -3731,11 +5065,21 @@ static void parse_ifdef_ifndef_directive(bool const is_ifdef)
 		condition = true;
 	} else {
 		/* evaluate whether we are in true or false case */
-		condition = (bool)pp_token.base.symbol->pp_definition == is_ifdef;
+		symbol_t *const symbol = pp_token.base.symbol;
+		condition = (bool)symbol->pp_definition == is_ifdef;
 		next_input_token();
 
 		expect_directive_end(WARN_ERROR, ctx);
+
+		/* an #ifndef starting the file might be an include guard */
+		if (input.mi_state == MI_START) {
+			input.mi_state       = MI_IN_GUARD;
+			input.mi_conditional = conditional;
+			input.mi_guard       = symbol;
+		}
 	}
+	if (input.mi_state == MI_START)
+		input.mi_state = MI_INVALID;
 
 	conditional->condition = condition;
 
@@ -3747,6 +5091,8 @@ static void parse_ifdef_ifndef_directive(bool const is_ifdef)
 static void parse_else_directive(void)
 {
 	pp_conditional_t *const conditional = conditional_stack;
+	if (conditional != NULL && conditional == input.mi_conditional)
+		input.mi_state = MI_INVALID;
 	if (!conditional) {
 		errorf(&pp_token.base.pos, "#else without prior #if");
 	} else if (conditional->in_else) {
@@ -3771,6 +5117,9 @@ static void parse_endif_directive(void)
 	} else {
 		if (!conditional->skip)
 			skip_mode = false;
+		if (conditional == input.mi_conditional
+		 && input.mi_state == MI_IN_GUARD)
+			input.mi_state = MI_AFTER_GUARD;
 		pop_conditional();
 	}
 	eat_pp(TP_endif);
@@ -3791,6 +5140,26 @@ typedef enum stdc_pragma_value_kind_t {
 	STDC_VALUE_DEFAULT
 } stdc_pragma_value_kind_t;
 
+/** Records that the current file must not be read again. */
+static void parse_pragma_once(void)
+{
+	position_t const pos = pp_token.base.pos;
+	eat_pp(TP_once);
+	expect_directive_end(WARN_UNKNOWN_PRAGMAS, "#pragma once");
+	if (input_stack == NULL) {
+		warningf(WARN_OTHER, &pos, "#pragma once in main file");
+		return;
+	}
+	find_include(input.real_name)->once = true;
+
+#if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
+	FILE *const file = input_get_file(input.input);
+	struct stat st;
+	if (file != NULL && fstat(fileno(file), &st) == 0)
+		add_once_file(&st);
+#endif
+}
+
 static void parse_pragma_directive(void)
 {
 	eat_pp(TP_pragma);
@@ -3806,6 +5175,11 @@ static void parse_pragma_directive(void)
 		return;
 	}
 
+	if (pp_token.base.symbol->pp_ID == TP_once) {
+		parse_pragma_once();
+		return;
+	}
+
 	stdc_pragma_kind_t kind = STDC_UNKNOWN;
 	if (pp_token.base.symbol->pp_ID == TP_STDC && dialect.c99) {
 		/* a STDC pragma */
@@ -3841,6 +5215,8 @@ static void parse_pragma_directive(void)
 
 static void parse_line_directive(void)
 {
+	position_t const pos  = *input_position();
+	position_info_t  info = get_position_info(&pos);
 	if (pp_token.kind != T_NUMBER) {
 		if (!skip_mode)
 			parse_error("expected integer");
@@ -3849,20 +5225,20 @@ static void parse_line_directive(void)
 		long const line = strtol(pp_token.literal.string->begin, &end, 0);
 		if (*end == '\0') {
 			/* use offset -1 as this is about the next line */
-			input.pos.lineno = line - 1;
+			info.lineno = line - 1;
 			/* force output of line */
-			input.output_line = input.pos.lineno - 20;
+			input.output_line = info.lineno - 20;
 		} else if (!skip_mode) {
-			errorf(&input.pos, "'%S' is not a valid line number", pp_token.literal.string);
+			errorf(input_position(), "'%S' is not a valid line number", pp_token.literal.string);
 		}
 		next_input_token();
 		if (pp_token.kind == '\n')
-			return;
+			goto end_directive;
 	}
 	if (pp_token.kind == T_STRING_LITERAL
 	    && pp_token.literal.string->encoding == STRING_ENCODING_CHAR) {
-		input.pos.input_name       = pp_token.literal.string->begin;
-		input.pos.is_system_header = false;
+		info.input_name       = pp_token.literal.string->begin;
+		info.is_system_header = false;
 		next_input_token();
 
 		/* attempt to parse numeric flags as outputted by gcc preprocessor */
@@ -3876,13 +5252,16 @@ static void parse_line_directive(void)
 			 * currently we're only interested in "3"
 			 */
 			if (streq(pp_token.literal.string->begin, "3")) {
-				input.pos.is_system_header = true;
+				info.is_system_header = true;
 			}
 			next_input_token();
 		}
 	}
 
 	expect_directive_end(WARN_OTHER, "#line directive");
+end_directive:
+	if (!skip_mode)
+		add_line_directive(pos, info.input_name, info.lineno, info.is_system_header);
 }
 
 static void parse_diagnostic_directive(bool const is_error)
@@ -3958,6 +5337,285 @@ static void parse_ident_directive(char const *const ctx)
 	}
 }
 
+/** the resource opened by the last successful try_open_resource() */
+static pp_resource_t *opened_resource;
+
+static include_result_t try_open_resource(char const *const name,
+                                          searchpath_entry_t *const path,
+                                          bool const is_system_header)
+{
+	(void)path;
+	include_t const *const include = find_include(name);
+	if (include != NULL && include->error != 0) {
+		errno = include->error;
+		return INCLUDE_NOT_FOUND;
+	}
+
+	/* a file embedded several times is read only once */
+	for (size_t i = 0, n = ARR_LEN(resources); i != n; ++i) {
+		if (strcmp(resources[i]->filename, name) == 0) {
+			opened_resource = resources[i];
+			return INCLUDE_ENTERED;
+		}
+	}
+
+	FILE *const file = fopen(name, "rb");
+	if (!file) {
+		remember_missing(name);
+		return INCLUDE_NOT_FOUND;
+	}
+	char const *const filename = make_string(name)->begin;
+	record_include(filename, is_system_header);
+
+	pp_resource_t *const resource = OALLOCZ(&include_obstack, pp_resource_t);
+	resource->filename = filename;
+	resource->input    = input_from_binary_stream(file);
+	input_get_bytes(resource->input, &resource->resource.data,
+	                &resource->resource.size);
+	/* the data is mapped or read completely, the input does not need the
+	 * stream anymore */
+	fclose(file);
+	ARR_APP1(pp_resource_t*, resources, resource);
+	opened_resource = resource;
+	return INCLUDE_ENTERED;
+}
+
+/**
+ * Appends the tokens of the parenthesized argument of an #embed parameter to
+ * @p tokens. The current token is the opening parenthesis.
+ */
+static bool parse_embed_tokens(token_t **const tokens)
+{
+	unsigned depth = 0;
+	for (;;) {
+		next_input_token();
+		switch (pp_token.kind) {
+		case T_NEWLINE:
+		case T_EOF:
+			errorf(&pp_token.base.pos, "missing ')' in #embed parameter");
+			return false;
+
+		case '(':
+			++depth;
+			break;
+
+		case ')':
+			if (depth == 0) {
+				next_input_token();
+				return true;
+			}
+			--depth;
+			break;
+
+		default:
+			break;
+		}
+		if (tokens != NULL)
+			ARR_APP1(token_t, *tokens, pp_token);
+	}
+}
+
+/** Parses the argument of the limit parameter, the current token is '('. */
+static bool parse_embed_limit(size_t *const limit)
+{
+	bool const old_resolve_escape_sequences = resolve_escape_sequences;
+	resolve_escape_sequences = true;
+
+	next_condition_token();
+	pp_value_t const value = parse_pp_expression(PREC_BOTTOM);
+
+	resolve_escape_sequences = old_resolve_escape_sequences;
+
+	if (pp_token.kind != ')') {
+		errorf(&pp_token.base.pos, "expected ')' after limit, got %K",
+		       &pp_token);
+		return false;
+	}
+	next_input_token();
+	if (value.bad)
+		return false;
+	if (!value.is_unsigned && (int64_t)value.bits < 0) {
+		errorf(&pp_token.base.pos, "negative #embed limit");
+		return false;
+	}
+	*limit = value.bits < SIZE_MAX ? (size_t)value.bits : SIZE_MAX;
+	return true;
+}
+
+static void append_embed_tokens(token_t const *const tokens)
+{
+	if (tokens == NULL)
+		return;
+	size_t const n = ARR_LEN(tokens);
+	if (n == 0)
+		return;
+	if (embed_tokens == NULL)
+		embed_tokens = NEW_ARR_F(token_t, 0);
+	ARR_EXTEND(token_t, embed_tokens, n);
+	memcpy(&embed_tokens[ARR_LEN(embed_tokens) - n], tokens, n * sizeof(*tokens));
+}
+
+/**
+ * Parses an #embed directive (C23 6.10.4). The bytes of the file become a
+ * single T_EMBED token, which is only split into numbers where the parser
+ * cannot take the data as a whole.
+ */
+static void parse_embed_directive(void)
+{
+	if (skip_mode) {
+exit_skip:
+		skip_till_newline(false);
+		eat_pp_directive();
+		return;
+	}
+
+	skip_till_newline(true);
+	bool              system_include;
+	const char *const headername = parse_headername(&system_include);
+	if (headername == NULL)
+		goto exit_skip;
+	position_t const pos = pp_token.base.pos;
+
+	size_t   limit     = SIZE_MAX;
+	bool     has_limit = false;
+	bool     valid     = true;
+	token_t *prefix    = NULL;
+	token_t *suffix    = NULL;
+	token_t *if_empty  = NULL;
+	next_input_token();
+	while (pp_token.kind != T_NEWLINE && pp_token.kind != T_EOF) {
+		symbol_t *const symbol = pp_token.base.symbol;
+		if (pp_token.kind != T_IDENTIFIER) {
+			errorf(&pp_token.base.pos, "expected #embed parameter, got %K",
+			       &pp_token);
+			valid = false;
+			break;
+		}
+		next_input_token();
+		if (pp_token.kind != '(') {
+			errorf(&pp_token.base.pos,
+			       "expected '(' after #embed parameter '%Y'", symbol);
+			valid = false;
+			break;
+		}
+
+		token_t **tokens;
+		switch (symbol->pp_ID) {
+		case TP_limit:
+		case TP___limit__:
+			if (has_limit) {
+				errorf(&pp_token.base.pos,
+				       "duplicate #embed parameter '%Y'", symbol);
+				valid = false;
+			}
+			has_limit = true;
+			if (!parse_embed_limit(&limit)) {
+				valid = false;
+				eat_pp_directive();
+			}
+			continue;
+
+		case TP_prefix:
+		case TP___prefix__:   tokens = &prefix;   goto parameter_tokens;
+		case TP_suffix:
+		case TP___suffix__:   tokens = &suffix;   goto parameter_tokens;
+		case TP_if_empty:
+		case TP___if_empty__: tokens = &if_empty; goto parameter_tokens;
+parameter_tokens:
+			if (*tokens != NULL) {
+				errorf(&pp_token.base.pos,
+				       "duplicate #embed parameter '%Y'", symbol);
+				valid = false;
+			} else {
+				*tokens = NEW_ARR_F(token_t, 0);
+			}
+			if (!parse_embed_tokens(tokens))
+				valid = false;
+			continue;
+
+		default:
+			errorf(&pp_token.base.pos, "unknown #embed parameter '%Y'",
+			       symbol);
+			valid = false;
+			parse_embed_tokens(NULL);
+			continue;
+		}
+	}
+
+	if (valid) {
+		switch (do_include(system_include, false, headername, try_open_resource)) {
+		case INCLUDE_ENTERED: {
+			resource_t const *resource = &opened_resource->resource;
+			if (resource->size > limit) {
+				resource_t *const limited = OALLOC(&include_obstack, resource_t);
+				limited->data = resource->data;
+				limited->size = limit;
+				resource      = limited;
+			}
+			if (scan_directives_only)
+				break;
+			if (resource->size == 0) {
+				append_embed_tokens(if_empty);
+				break;
+			}
+			append_embed_tokens(prefix);
+			if (embed_tokens == NULL)
+				embed_tokens = NEW_ARR_F(token_t, 0);
+			token_t const data = {
+				.embed = {
+					.base = {
+						.kind         = T_EMBED,
+						.space_before = ARR_LEN(embed_tokens) != 0,
+						.pos          = pos,
+					},
+					.resource = resource,
+				},
+			};
+			ARR_APP1(token_t, embed_tokens, data);
+			append_embed_tokens(suffix);
+			break;
+		}
+		case INCLUDE_SKIPPED:
+			panic("embedded resource skipped");
+		case INCLUDE_NOT_FOUND: {
+			char const ldelim = system_include ? '<' : '"';
+			char const rdelim = system_include ? '>' : '"';
+			errorf(&pos, "failed embedding %c%s%c: %s", ldelim, headername, rdelim, strerror(errno));
+			break;
+		}
+		}
+	}
+
+	if (prefix != NULL)
+		DEL_ARR_F(prefix);
+	if (suffix != NULL)
+		DEL_ARR_F(suffix);
+	if (if_empty != NULL)
+		DEL_ARR_F(if_empty);
+	eat_pp_directive();
+}
+
+/**
+ * Moves to the next token replacing an #embed directive. Returns false if
+ * there are none left.
+ */
+static bool next_embed_token(void)
+{
+	if (embed_tokens == NULL)
+		return false;
+
+	/* the tokens start a new line in place of the directive */
+	info.at_line_begin            = embed_pos == 0;
+	info.whitespace_at_line_begin = 0;
+	pp_token                      = embed_tokens[embed_pos++];
+	if (embed_pos == ARR_LEN(embed_tokens)) {
+		DEL_ARR_F(embed_tokens);
+		embed_tokens = NULL;
+		embed_pos    = 0;
+	}
+	return true;
+}
+
 static void parse_preprocessing_directive(void)
 {
 	if (current_call.macro != NULL) {
@@ -3970,6 +5628,13 @@ static void parse_preprocessing_directive(void)
 	stop_at_newline = true;
 	eat_token('#');
 
+	/* the #ifndef of the include guard is the only directive allowed outside
+	 * of it */
+	if (input.mi_state != MI_IN_GUARD
+	 && (input.mi_state != MI_START || pp_token.base.symbol == NULL
+	     || pp_token.base.symbol->pp_ID != TP_ifndef))
+		input.mi_state = MI_INVALID;
+
 	if (pp_token.kind == '\n') {
 		/* empty directive */
 	} else if (pp_token.base.symbol) {
@@ -3977,6 +5642,7 @@ static void parse_preprocessing_directive(void)
 		case TP_define:       parse_define_directive();            break;
 		case TP_elif:         parse_elif_directive();              break;
 		case TP_else:         parse_else_directive();              break;
+		case TP_embed:        parse_embed_directive();             break;
 		case TP_endif:        parse_endif_directive();             break;
 		case TP_error:        parse_diagnostic_directive(true);    break;
 		case TP_ident:        parse_ident_directive("#ident");     break;
@@ -4005,7 +5671,102 @@ skip:
 	pop_macro_call();
 
 	stop_at_newline = false;
-	eat_token(T_NEWLINE);
+	if (skip_mode || scan_directives_only) {
+		uint32_t const skip_begin = input_position()->offset;
+		skip_conditional_lines();
+		if (profiling && skip_mode && profile_current != NO_PROFILE_FILE) {
+			profile_files[profile_current].skipped_bytes
+				+= input_position()->offset - skip_begin;
+		}
+	}
+	/* the tokens replacing an #embed come before the newline ending it */
+	if (embed_tokens == NULL)
+		eat_token(T_NEWLINE);
+}
+
+/**
+ * Fully macro-expands the argument of @p parameter on its own, as if it formed
+ * the rest of the translation unit (C99 6.10.3.1), and remembers the result so
+ * that further uses of the parameter in the same macro call need not expand
+ * the argument again.
+ */
+static void expand_argument(pp_definition_t *const parameter)
+{
+	token_t           const saved_token              = pp_token;
+	whitespace_info_t const saved_info               = info;
+	whitespace_info_t const saved_call_info          = call_whitespace_info;
+	bool              const saved_call_space_before  = call_space_before;
+	pp_definition_t  *const saved_argument_expanding = argument_expanding;
+	size_t            const saved_base               = argument_expansion_base;
+	push_macro_call();
+	argument_expanding      = NULL;
+	argument_expansion_base = ARR_LEN(expansion_stack);
+
+	/* the whitespace in front of the argument is added for each use */
+	token_t *list = new_argument_list();
+	pp_token.base.space_before = false;
+	start_object_macro_expansion(parameter);
+	for (;;) {
+		if (!expand_next()) {
+			if (current_call.macro == NULL)
+				break;
+			errorf(&expansion_pos,
+			       "unterminated argument list invoking macro '%Y'",
+			       current_call.macro->symbol);
+			start_function_macro_expansion(&current_call);
+			pop_macro_call();
+			continue;
+		}
+		if (!start_expanding())
+			ARR_APP1(token_t, list, pp_token);
+	}
+	parameter->expanded_list = list;
+
+	pop_macro_call();
+	argument_expanding      = saved_argument_expanding;
+	argument_expansion_base = saved_base;
+	call_space_before       = saved_call_space_before;
+	call_whitespace_info    = saved_call_info;
+	info                    = saved_info;
+	pp_token                = saved_token;
+}
+
+/** Returns whether the tokens contain names of macros that may get expanded. */
+static bool may_expand(token_t const *const tokens, size_t const n_tokens)
+{
+	for (size_t i = 0; i < n_tokens; ++i) {
+		symbol_t const *const symbol = tokens[i].base.symbol;
+		if (symbol != NULL && symbol->pp_definition != NULL
+		    && !tokens[i].base.expansion_forbidden)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Starts the replacement of a parameter in a macro body. The argument of a
+ * parameter used several times is expanded only once per macro call.
+ */
+static void start_parameter_expansion(pp_definition_t *const parameter)
+{
+	if (current_expansion->expand_parameter_before_concat) {
+		start_object_macro_expansion(parameter);
+		return;
+	}
+	if (parameter->expanded_list == NULL) {
+		if (!parameter->expand_once
+		    || !may_expand(parameter->token_list, parameter->list_len)) {
+			start_object_macro_expansion(parameter);
+			return;
+		}
+		expand_argument(parameter);
+	}
+	start_object_macro_expansion(parameter);
+	token_t *const list = parameter->expanded_list;
+	current_expansion->list_len   = ARR_LEN(list);
+	current_expansion->token_list = list;
+	if (ARR_LEN(list) > 0)
+		pp_token.base.space_before |= list[0].base.space_before;
 }
 
 /**
@@ -4023,7 +5784,7 @@ static bool start_expanding(void)
 			if (kind == T_MACRO_PARAMETER) {
 				pp_definition_t *def = pp_token.macro_parameter.def;
 				assert(current_expansion != NULL);
-				start_object_macro_expansion(def);
+				start_parameter_expansion(def);
 				return true;
 			}
 
@@ -4040,7 +5801,8 @@ static bool start_expanding(void)
 						bool         may_pop    = !pp_token.base.expansion_forbidden;
 						token_kind_t next_token = peek_expansion(may_pop);
 						if (next_token != '(') {
-							if (next_token == T_EOF && may_pop)
+							if (next_token == T_EOF && may_pop
+							    && argument_expansion_base == 0)
 								goto try_input;
 							goto have_token;
 						}
@@ -4060,7 +5822,7 @@ try_input:;
 					push_macro_call();
 					whitespace_info_t oldinfo      = info;
 					bool              space_before = pp_token.base.space_before;
-					next_preprocessing_token();
+					next_expanded_token();
 					assert(pp_token.kind == '(');
 
 					start_call(pp_definition, oldinfo, space_before);
@@ -4111,7 +5873,7 @@ have_token:
 			 * parameters for another macro-call */
 			pp_definition_t *argument = pp_token.macro_parameter.def;
 			argument_expanding = argument;
-			start_object_macro_expansion(argument);
+			start_parameter_expansion(argument);
 			return true;
 		} else if (kind == T_EOF) {
 			errorf(&expansion_pos,
@@ -4130,21 +5892,61 @@ have_token:
 	return false;
 }
 
-void next_preprocessing_token(void)
+/** Reads the next token from the input, evaluating preprocessing directives
+ * but not expanding macros. */
+static void next_directive_processed_token(void)
 {
-	do {
-		if (expand_next())
-			continue;
-
+	if (!next_embed_token()) {
 		do {
 			next_input_token();
 			while (pp_token.kind == '#' && info.at_line_begin) {
 				parse_preprocessing_directive();
+				/* the tokens replacing an #embed are no directive */
+				if (next_embed_token())
+					break;
 			}
 		} while (skip_mode && pp_token.kind != T_EOF);
+	}
+
+	/* a token outside of the include guard */
+	if (input.mi_state != MI_IN_GUARD)
+		input.mi_state = MI_INVALID;
+}
+
+static void next_expanded_token(void)
+{
+	do {
+		if (expand_next())
+			continue;
+		next_directive_processed_token();
 	} while (start_expanding());
 }
 
+void next_preprocessing_token(void)
+{
+	if (keep_macro_directives()) {
+		next_directive_processed_token();
+	} else {
+		next_expanded_token();
+	}
+	if (profiling)
+		profile_token();
+}
+
+void scan_preprocessing_directives(void)
+{
+	assert(out == NULL);
+	scan_directives_only = true;
+	do {
+		skip_conditional_lines();
+		next_input_token();
+		while (pp_token.kind == '#' && info.at_line_begin) {
+			parse_preprocessing_directive();
+		}
+	} while (pp_token.kind != T_EOF);
+	scan_directives_only = false;
+}
+
 static void next_condition_token(void)
 {
 	do {
@@ -4247,73 +6049,111 @@ void print_defines(void)
 			continue;
 		if (definition->update != NULL)
 			definition->update(definition);
-		fprintf(out, "#define %s", definition->symbol->string);
-		if (definition->has_parameters) {
-			fputc('(', out);
-			separator_t sep = { "", ", " };
-			for (size_t i = 0; i != definition->n_parameters; ++i) {
-				fputs(sep_next(&sep), out);
-				pp_definition_t *const param = &definition->parameters[i];
-				if (!param->is_variadic) {
-					fprintf(out, "%s", param->symbol->string);
-				} else if (param->symbol == symbol___VA_ARGS__) {
-					fputs("...", out);
-				} else {
-					fprintf(out, "%s...", param->symbol->string);
-				}
-			}
-			fputc(')', out);
-		}
-		fputc(' ', out);
-		memset(&previous_token, 0, sizeof(previous_token));
-		if (definition->list_len > 0)
-			definition->token_list[0].base.space_before = false;
-		for (size_t t = 0; t < definition->list_len; ++t) {
-			const token_t *token = &definition->token_list[t];
-			pp_token = *token;
-			emit_pp_token();
-		}
-		fputc('\n', out);
+		print_definition(definition);
+		out_char('\n');
 	}
 }
 
 static void input_error(unsigned const delta_lines, unsigned const delta_cols, char const *const message)
 {
-	position_t pos = input.pos;
-	/* see hack at end for switch_input() */
-	if (pos.lineno == 0)
-		pos.lineno = 1;
-	if (delta_lines > 0) {
-		pos.lineno += delta_lines;
-		pos.colno = delta_cols;
-	} else {
-		pos.colno += delta_cols;
-	}
+	/* The error is at the byte which is read next. Errors while decoding a
+	 * whole input are reported at the current position, the line table of
+	 * the input does not exist yet. */
+	char const *const cur = input.cur == putback_marker ? input.saved_cur
+	                                                    : input.cur;
+	position_t pos = byte_position(cur);
+	if (delta_lines == 0)
+		pos.offset += delta_cols;
 	warningf(WARN_INVALID_BYTE_SEQUENCE, &pos, "%s", message);
 }
 
+/**
+ * Starts a new offset space for the positions of a compilation unit, so the
+ * 32-bit offsets only have to cover the input of a single unit.
+ */
+static void init_unit_positions(void)
+{
+	init_positions();
+	input = (pp_input_t){ .start = file_position("<commandline>") };
+}
+
 void init_preprocessor(void)
 {
 	init_string_hash();
 	init_symbol_table();
 	init_symbols();
+	init_char_classes();
 	obstack_init(&config_obstack);
 	obstack_init(&pp_obstack);
-	input.pos.input_name = "<commandline>";
-	input.pos.lineno     = 0;
-	input.pos.colno      = 0;
+	init_unit_positions();
 
 	init_dynamic_macros();
 }
 
+/** Frees the state set up for a compilation unit by setup_preprocessor(). */
+static void exit_unit_state(void)
+{
+	include_set_destroy_(&includeset);
+#if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
+	DEL_ARR_F(once_files);
+#endif
+	DEL_ARR_F(macro_call_stack);
+	for (size_t i = 0, n = ARR_LEN(free_argument_lists); i != n; ++i) {
+		DEL_ARR_F(free_argument_lists[i]);
+	}
+	DEL_ARR_F(free_argument_lists);
+	DEL_ARR_F(argument_stack);
+	DEL_ARR_F(expansion_stack);
+	for (size_t i = 0, n = ARR_LEN(resources); i != n; ++i) {
+		pp_resource_t *const resource = resources[i];
+		input_free(resource->input);
+	}
+	DEL_ARR_F(resources);
+	if (embed_tokens != NULL) {
+		DEL_ARR_F(embed_tokens);
+		embed_tokens = NULL;
+		embed_pos    = 0;
+	}
+	obstack_free(&include_obstack, NULL);
+	obstack_free(&input_obstack, NULL);
+}
+
+/** Forgets the macros and includes of the previous compilation unit. */
+static void reset_definitions(void)
+{
+	symbol_table_iterator_t iter;
+	symbol_table_iterator_init(&iter);
+	for (symbol_t *symbol; (symbol = symbol_table_iterator_next(&iter)) != NULL;) {
+		symbol->pp_definition = NULL;
+	}
+	obstack_free(&pp_obstack, NULL);
+	obstack_init(&pp_obstack);
+	counter = 0;
+	init_dynamic_macros();
+}
+
 void setup_preprocessor(void)
 {
+	if (macro_call_stack != NULL) {
+		/* another compilation unit in the same invocation */
+		exit_unit_state();
+		reset_definitions();
+		exit_positions();
+		init_unit_positions();
+	}
+
 	init_tokens();
 	obstack_init(&input_obstack);
-	expansion_stack  = NEW_ARR_F(pp_expansion_state_t, 0);
-	argument_stack   = NEW_ARR_F(pp_argument_t, 0);
-	macro_call_stack = NEW_ARR_F(macro_call_t, 0);
-	pset_new_init(&includeset);
+	obstack_init(&include_obstack);
+	expansion_stack     = NEW_ARR_F(pp_expansion_state_t, 0);
+	argument_stack      = NEW_ARR_F(pp_argument_t, 0);
+	free_argument_lists = NEW_ARR_F(token_t*, 0);
+	macro_call_stack    = NEW_ARR_F(macro_call_t, 0);
+	resources           = NEW_ARR_F(pp_resource_t*, 0);
+	include_set_init_(&includeset);
+#if defined(HAVE_FILENO) && defined(HAVE_FSTAT)
+	once_files = NEW_ARR_F(file_id_t, 0);
+#endif
 	includes = NULL;
 	last_include = NULL;
 
@@ -4321,8 +6161,6 @@ void setup_preprocessor(void)
 
 	set_input_error_callback(input_error);
 
-	pp_null = get_mode_null(mode_Ls);
-	pp_one  = get_mode_one(mode_Ls);
 	set_preprocessor_output(NULL);
 }
 
@@ -4330,14 +6168,16 @@ void exit_preprocessor(void)
 {
 	if (macro_call_stack == NULL)
 		return;
-	pset_new_destroy(&includeset);
-	DEL_ARR_F(macro_call_stack);
-	DEL_ARR_F(argument_stack);
-	DEL_ARR_F(expansion_stack);
-	obstack_free(&input_obstack, NULL);
+	exit_unit_state();
+	if (profile_files != NULL) {
+		DEL_ARR_F(profile_macros);
+		DEL_ARR_F(profile_files);
+		ir_timer_free(profile_timer);
+	}
 	obstack_free(&pp_obstack, NULL);
 	obstack_free(&config_obstack, NULL);
 	exit_tokens();
 	exit_symbol_table();
 	exit_string_hash();
+	exit_positions();
 }
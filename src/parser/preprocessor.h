@@ -34,6 +34,9 @@ void close_pp_input(void);
 /** print the header displayed by gcc when writing preprocessing tokens */
 void print_pp_header(void);
 
+/** end the preprocessed output with a newline and write out all of it */
+void finish_pp_output(void);
+
 /**
  * Advance to the next token. This evaluates preprocessing directives, expands
  * macros, executes token concatenation, stringification.
@@ -41,6 +44,13 @@ void print_pp_header(void);
  */
 void next_preprocessing_token(void);
 
+/**
+ * Evaluate the preprocessing directives of the whole input, skipping all other
+ * lines like an excluded conditional block. Macros are only expanded in
+ * directives, which is enough to find the included files.
+ */
+void scan_preprocessing_directives(void);
+
 /**
  * @param standard_define    The definition is mentioned as predefined macro
  *                           in the C standard (so we issue warnings/errors
@@ -57,6 +67,9 @@ void undefine(char const *name);
 string_t *make_string(char const *string);
 
 extern bool             no_dollar_in_symbol;
+/** When writing preprocessed output, evaluate directives but keep macro
+ * invocations and #define/#undef directives for a later expansion. */
+extern bool             directives_only;
 extern token_t          pp_token;
 extern input_decoder_t *input_decoder;
 
@@ -81,4 +94,13 @@ void append_env_paths(searchpath_t *paths, const char *envvar);
 void print_include_paths(void);
 void print_defines(void);
 
+/** Start recording the preprocessor profile for the next input. */
+void start_pp_profile(void);
+/**
+ * Print the profile of the finished input as one line of JSON: the include
+ * tree with the time spent in each input, and the most expensive files and
+ * macros.
+ */
+void print_pp_profile(FILE *out);
+
 #endif
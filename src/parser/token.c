@@ -14,8 +14,6 @@
 
 symbol_t *token_symbols[T_LAST_TOKEN];
 
-const position_t builtin_position = { "<built-in>", 0, 0, true };
-
 static token_kind_t last_id;
 
 static symbol_t *intern_register_token(token_kind_t id, const char *string)
@@ -34,6 +34,8 @@ extern symbol_t *token_symbols[];
 typedef struct token_base_t      token_base_t;
 typedef struct literal_t         literal_t;
 typedef struct macro_parameter_t macro_parameter_t;
+typedef struct resource_t        resource_t;
+typedef struct embed_t           embed_t;
 typedef union  token_t           token_t;
 
 struct token_base_t {
@@ -57,11 +59,27 @@ struct macro_parameter_t {
 	pp_definition_t *def;
 };
 
+/**
+ * The contents of a file included by #embed. They stay valid until the next
+ * compilation unit is preprocessed.
+ */
+struct resource_t {
+	const unsigned char *data;
+	size_t               size;
+};
+
+/** The bytes of a resource, standing for a comma separated list of them. */
+struct embed_t {
+	token_base_t      base;
+	const resource_t *resource;
+};
+
 union token_t {
 	ENUMBF(token_kind_t) kind : 16;
 	token_base_t      base;
 	literal_t         literal;
 	macro_parameter_t macro_parameter;
+	embed_t           embed;
 };
 
 char const *get_string_encoding_prefix(string_encoding_t);
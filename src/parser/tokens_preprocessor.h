@@ -11,21 +11,31 @@ T(OFF)
 T(ON)
 T(STDC)
 T(U)
+T(__if_empty__)
+T(__limit__)
+T(__prefix__)
+T(__suffix__)
 T(define)
 T(defined)
 T(elif)
 T(else)  /* remember that this gives T_else, not T_IDENTIFIER like most others */
+T(embed)
 T(endif)
 T(error)
 T(ident)
 T(if)    /* remember that this gives T_if */
+T(if_empty)
 T(ifdef)
 T(ifndef)
 T(include)
 T(include_next)
+T(limit)
 T(line)
+T(once)
 T(pragma)
+T(prefix)
 T(sccs)
+T(suffix)
 T(u)
 T(u8)
 T(undef)
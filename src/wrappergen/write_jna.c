@@ -502,13 +502,14 @@ void write_jna_decls(FILE *output, const translation_unit_t *unit)
 	for ( ; entity != NULL; entity = entity->base.next) {
 		if (entity->kind != ENTITY_FUNCTION)
 			continue;
-		if (entity->base.pos.is_system_header)
+		if (is_system_header_position(&entity->base.pos))
 			continue;
 		if (entity->function.elf_visibility != ELF_VISIBILITY_DEFAULT)
 			continue;
 		if (output_limits != NULL) {
 			bool              in_limits  = false;
-			char const *const input_name = entity->base.pos.input_name;
+			char const *const input_name
+				= get_position_info(&entity->base.pos).input_name;
 			for (output_limit *limit = output_limits; limit != NULL;
 			     limit = limit->next) {
 			    if (streq(limit->filename, input_name)) {